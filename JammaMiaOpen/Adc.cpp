@@ -0,0 +1,205 @@
+/*
+  Free-running interrupt-driven ADC sequencer for the analog inputs
+
+  The ADC-complete interrupt stores the result, selects the next enabled
+  channel and starts its conversion, so the main loop never waits for the
+  ADC. A full sequence of channels is published in a double buffer.
+
+  Each channel can be oversampled (4^n conversions summed then decimated,
+  +n bits of resolution) and filtered by a fixed-point EMA or a median of
+  the last 3 or 5 samples. Values are always scaled to AIN_BITS.
+*/
+#include "Adc.h"
+#include <util/atomic.h>
+
+namespace Adc {
+
+// Multiplexer selection of each analog input
+static uint8_t Mux[NB_ANALOGINPUTS];
+static bool Mux5[NB_ANALOGINPUTS];
+// Oversampling of each analog input: 4^n conversions per sample
+static uint8_t Oversampling[NB_ANALOGINPUTS];
+// Enabled analog inputs, in conversion order
+static uint8_t Channels[NB_ANALOGINPUTS];
+static volatile uint8_t NbChannels = 0;
+static uint8_t ChannelIdx = 0;
+static bool IsSetup = false;
+// Conversion started before a reconfiguration: its result is from the old sequence
+static volatile bool DropNext = false;
+// Oversampling accumulator of current channel
+static uint16_t Accu = 0;
+static uint8_t NbSamples = 0;
+
+// Double buffered results: ISR writes the back one and flips at end of a sequence
+static int16_t Results[2][NB_ANALOGINPUTS];
+static volatile uint8_t Front = 0;
+static volatile bool ResultsReady = false;
+
+// Filters state: EMA with 4 fractional bits, median history
+#define EMA_FRAC_BITS (4)
+#define MEDIAN_MAX (5)
+static uint16_t EMA[NB_ANALOGINPUTS];
+static int16_t History[NB_ANALOGINPUTS][MEDIAN_MAX];
+static uint8_t HistoryIdx[NB_ANALOGINPUTS];
+static bool FilterPrimed[NB_ANALOGINPUTS];
+
+static void SelectAndStart(uint8_t ain) {
+  ADCSRB = (ADCSRB & ~_BV(MUX5)) | (Mux5[ain] ? _BV(MUX5) : 0);
+  // AVcc reference
+  ADMUX = _BV(REFS0) | Mux[ain];
+  ADCSRA |= _BV(ADSC);
+}
+
+ISR(ADC_vect) {
+  if (DropNext) {
+    // Restart the new sequence from its first channel
+    DropNext = false;
+    if (NbChannels > 0) {
+      SelectAndStart(Channels[0]);
+    }
+    return;
+  }
+  uint8_t ain = Channels[ChannelIdx];
+  uint8_t os = Oversampling[ain];
+  Accu += ADC;
+  if (++NbSamples < (uint8_t)(1 << (2 * os))) {
+    // Convert same channel again
+    ADCSRA |= _BV(ADSC);
+    return;
+  }
+  // Decimate to 10+os bits, then scale to AIN_BITS
+  uint8_t back = Front ^ 1;
+  Results[back][ain] = (int16_t)((Accu >> os) << (AIN_BITS - 10 - os));
+  Accu = 0;
+  NbSamples = 0;
+  if (++ChannelIdx >= NbChannels) {
+    // Sequence done: publish it
+    ChannelIdx = 0;
+    Front = back;
+    ResultsReady = true;
+  }
+  if (NbChannels > 0) {
+    SelectAndStart(Channels[ChannelIdx]);
+  }
+}
+
+// pins: MCU pins of the analog inputs
+void Setup(const int pins[NB_ANALOGINPUTS]) {
+  for (uint8_t i = 0; i < NB_ANALOGINPUTS; i++) {
+    uint8_t pin = pins[i];
+    if (pin >= A0) {
+      pin -= A0;
+    }
+    uint8_t channel = analogPinToChannel(pin);
+    Mux[i] = channel & 0x07;
+    Mux5[i] = (channel >> 3) & 0x01;
+    // Digital input buffer not needed on analog inputs
+    if (channel < 8) {
+      DIDR0 |= _BV(channel);
+    }
+  }
+  // ADC enabled with interrupt, prescaler of 128 (125kHz ADC clock, ~104us per conversion)
+  ADCSRA = _BV(ADEN) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+  IsSetup = true;
+  Configure();
+}
+
+// Update enabled channels and filters from config, skipping inputs mapped to nothing
+void Configure() {
+  if (!IsSetup)
+    return;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    bool wasRunning = NbChannels > 0;
+    uint8_t nb = 0;
+    for (uint8_t i = 0; i < NB_ANALOGINPUTS; i++) {
+      byte filter = Config::ConfigFile.AnalogInDB[i].Filter;
+      uint8_t os = filter & Config::AInFilters::OversamplingMask;
+      Oversampling[i] = (os > AIN_MAX_OVERSAMPLING) ? AIN_MAX_OVERSAMPLING : os;
+      FilterPrimed[i] = false;
+      if (Config::ConfigFile.AnalogInDB[i].Type != Config::MappingType::Nothing) {
+        Channels[nb++] = i;
+      }
+    }
+    NbChannels = nb;
+    ChannelIdx = 0;
+    Accu = 0;
+    NbSamples = 0;
+    // The ISR keeps the sequence running, only start it when idle.
+    // Otherwise a conversion is in flight: the ISR drops it and starts the new sequence
+    if (wasRunning) {
+      DropNext = true;
+    } else if (nb > 0) {
+      SelectAndStart(Channels[0]);
+    }
+  }
+}
+
+static int16_t Median(const int16_t *samples, uint8_t n) {
+  int16_t sorted[MEDIAN_MAX];
+  // Insertion sort of a copy
+  for (uint8_t i = 0; i < n; i++) {
+    int16_t v = samples[i];
+    uint8_t j = i;
+    while (j > 0 && sorted[j - 1] > v) {
+      sorted[j] = sorted[j - 1];
+      j--;
+    }
+    sorted[j] = v;
+  }
+  return sorted[n >> 1];
+}
+
+static int16_t Filter(uint8_t ain, int16_t value) {
+  byte filter = Config::ConfigFile.AnalogInDB[ain].Filter;
+  if (!FilterPrimed[ain]) {
+    // Start filters from first value
+    EMA[ain] = (uint16_t)value << EMA_FRAC_BITS;
+    for (uint8_t i = 0; i < MEDIAN_MAX; i++) {
+      History[ain][i] = value;
+    }
+    FilterPrimed[ain] = true;
+  }
+  switch (filter & Config::AInFilters::FilterMask) {
+    case Config::AInFilters::EMA:
+      {
+        // ema += (x - ema) / 2^k
+        uint8_t k = (filter & Config::AInFilters::EMAShiftMask) >> 4;
+        int32_t ema = EMA[ain];
+        ema += (((int32_t)value << EMA_FRAC_BITS) - ema) >> k;
+        EMA[ain] = (uint16_t)ema;
+        return (int16_t)((ema + (1 << (EMA_FRAC_BITS - 1))) >> EMA_FRAC_BITS);
+      }
+    case Config::AInFilters::Median3:
+    case Config::AInFilters::Median5:
+      {
+        uint8_t n = ((filter & Config::AInFilters::FilterMask) == Config::AInFilters::Median3) ? 3 : 5;
+        uint8_t idx = HistoryIdx[ain] + 1;
+        if (idx >= n) {
+          idx = 0;
+        }
+        HistoryIdx[ain] = idx;
+        History[ain][idx] = value;
+        return Median(History[ain], n);
+      }
+    default:
+      return value;
+  }
+}
+
+// Copy and filter last complete sequence, returns false if there is no new one
+bool Fetch(int16_t ain[NB_ANALOGINPUTS]) {
+  if (!ResultsReady)
+    return false;
+  int16_t results[NB_ANALOGINPUTS];
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    memcpy(results, Results[Front], sizeof(results));
+    ResultsReady = false;
+  }
+  for (uint8_t i = 0; i < NbChannels; i++) {
+    uint8_t ch = Channels[i];
+    ain[ch] = Filter(ch, results[ch]);
+  }
+  return true;
+}
+
+}
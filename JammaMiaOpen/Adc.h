@@ -0,0 +1,13 @@
+/*
+  Free-running interrupt-driven ADC sequencer for the analog inputs
+*/
+#pragma once
+#include "Config.h"
+
+namespace Adc {
+
+void Setup(const int pins[NB_ANALOGINPUTS]);
+void Configure();
+bool Fetch(int16_t ain[NB_ANALOGINPUTS]);
+
+}
@@ -0,0 +1,166 @@
+/*
+  Calibration of the analog inputs
+
+  While calibration runs, the first sample of each input is taken as its
+  center (sticks at rest) and min/max are tracked while the player moves
+  the sticks to their ends. Learnt values are stored in the configuration,
+  then each side of the center is mapped to the full axis range with a
+  precomputed Q8 scale, so that the hot path only has a multiply and a shift.
+
+  With drift tracking, the center slowly follows the input while it rests
+  close to it. The drifted center lives in the RAM configuration, it is only
+  written to eeprom with the next save.
+*/
+#include "Calib.h"
+#include "Globals.h"
+
+namespace Calib {
+
+// Minimum learnt span on each side of the center to accept a calibration
+#define CALIB_MIN_SPAN (64)
+// Window around the center where the input is considered resting
+#define CALIB_DRIFT_WINDOW (AIN_MAX_VAL >> 6)
+// Number of resting samples on the same side to move the center by 1
+#define CALIB_DRIFT_STEPS (64)
+
+// Output units per input unit, Q8, for each side of the center
+static uint16_t ScaleNeg[NB_ANALOGINPUTS];
+static uint16_t ScalePos[NB_ANALOGINPUTS];
+// Inputs with a valid calibration / drift tracking
+static uint8_t CalibratedMask = 0;
+static uint8_t DriftMask = 0;
+static int8_t DriftAccu[NB_ANALOGINPUTS];
+
+// Learning state
+static bool Running = false;
+static uint8_t CenterLearnt = 0;
+static int16_t LearnMin[NB_ANALOGINPUTS];
+static int16_t LearnCenter[NB_ANALOGINPUTS];
+static int16_t LearnMax[NB_ANALOGINPUTS];
+
+static uint16_t ComputeScale(int16_t span, int16_t out) {
+  return (uint16_t)(((uint32_t)out << 8) / (uint16_t)span);
+}
+
+static void SetupInput(uint8_t ain) {
+  auto &ainDB = Config::ConfigFile.AnalogInDB[ain];
+  uint8_t bit = 1 << ain;
+  CalibratedMask &= ~bit;
+  DriftMask &= ~bit;
+  DriftAccu[ain] = 0;
+  if (!(ainDB.Options & Config::AInOptions::Calibrated))
+    return;
+  int16_t neg = (int16_t)ainDB.CalCenter - (int16_t)ainDB.CalMin;
+  int16_t pos = (int16_t)ainDB.CalMax - (int16_t)ainDB.CalCenter;
+  if ((neg < CALIB_MIN_SPAN) || (pos < CALIB_MIN_SPAN))
+    return;
+  ScaleNeg[ain] = ComputeScale(neg, AIN_CENTERED_VAL);
+  ScalePos[ain] = ComputeScale(pos, AIN_MAX_VAL - AIN_CENTERED_VAL);
+  CalibratedMask |= bit;
+  if (ainDB.Options & Config::AInOptions::DriftTracking) {
+    DriftMask |= bit;
+  }
+}
+
+// Precompute scales from the configuration
+void Setup() {
+  for (uint8_t i = 0; i < NB_ANALOGINPUTS; i++) {
+    SetupInput(i);
+  }
+}
+
+void Start() {
+  CenterLearnt = 0;
+  Running = true;
+  Serial.println(F("Mcal start"));
+}
+
+// Store learnt values of inputs that moved enough on both sides, and save them in eeprom
+void Stop(bool save) {
+  if (!Running)
+    return;
+  Running = false;
+  if (save) {
+    for (uint8_t i = 0; i < NB_ANALOGINPUTS; i++) {
+      if (!(CenterLearnt & (1 << i)))
+        continue;
+      if (((LearnCenter[i] - LearnMin[i]) < CALIB_MIN_SPAN) || ((LearnMax[i] - LearnCenter[i]) < CALIB_MIN_SPAN))
+        continue;
+      auto &ainDB = Config::ConfigFile.AnalogInDB[i];
+      ainDB.CalMin = LearnMin[i];
+      ainDB.CalCenter = LearnCenter[i];
+      ainDB.CalMax = LearnMax[i];
+      ainDB.Options |= Config::AInOptions::Calibrated;
+    }
+    Config::UpdateRuntimeConfig();
+    Config::SaveConfigInBackground();
+  }
+  Serial.print(F("Mcal stop "));
+  Serial.println(CalibratedMask, HEX);
+}
+
+// Forget calibration of all inputs
+void Clear() {
+  for (uint8_t i = 0; i < NB_ANALOGINPUTS; i++) {
+    Config::ConfigFile.AnalogInDB[i].Options &= ~Config::AInOptions::Calibrated;
+  }
+  Setup();
+}
+
+bool IsRunning() {
+  return Running;
+}
+
+static void Learn(uint8_t ain, int16_t raw) {
+  uint8_t bit = 1 << ain;
+  if (!(CenterLearnt & bit)) {
+    LearnMin[ain] = raw;
+    LearnCenter[ain] = raw;
+    LearnMax[ain] = raw;
+    CenterLearnt |= bit;
+  } else if (raw < LearnMin[ain]) {
+    LearnMin[ain] = raw;
+  } else if (raw > LearnMax[ain]) {
+    LearnMax[ain] = raw;
+  }
+}
+
+static void TrackDrift(uint8_t ain, int16_t raw) {
+  auto &ainDB = Config::ConfigFile.AnalogInDB[ain];
+  int16_t delta = raw - (int16_t)ainDB.CalCenter;
+  if ((delta == 0) || (delta > CALIB_DRIFT_WINDOW) || (delta < -CALIB_DRIFT_WINDOW))
+    return;
+  DriftAccu[ain] += (delta > 0) ? 1 : -1;
+  if (DriftAccu[ain] >= CALIB_DRIFT_STEPS) {
+    ainDB.CalCenter++;
+  } else if (DriftAccu[ain] <= -CALIB_DRIFT_STEPS) {
+    ainDB.CalCenter--;
+  } else {
+    return;
+  }
+  // Center moved, recompute scales (rare)
+  SetupInput(ain);
+}
+
+// Map a raw value to the full axis range using learnt calibration
+int16_t Apply(uint8_t ain, int16_t raw) {
+  uint8_t bit = 1 << ain;
+  if (Running) {
+    Learn(ain, raw);
+    return raw;
+  }
+  if (!(CalibratedMask & bit))
+    return raw;
+  if (DriftMask & bit) {
+    TrackDrift(ain, raw);
+  }
+  int16_t center = Config::ConfigFile.AnalogInDB[ain].CalCenter;
+  if (raw < center) {
+    uint32_t d = ((uint32_t)(uint16_t)(center - raw) * ScaleNeg[ain]) >> 8;
+    return (d >= AIN_CENTERED_VAL) ? 0 : (int16_t)(AIN_CENTERED_VAL - d);
+  }
+  uint32_t d = ((uint32_t)(uint16_t)(raw - center) * ScalePos[ain]) >> 8;
+  return (d >= (AIN_MAX_VAL - AIN_CENTERED_VAL)) ? AIN_MAX_VAL : (int16_t)(AIN_CENTERED_VAL + d);
+}
+
+}
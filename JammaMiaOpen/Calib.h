@@ -0,0 +1,19 @@
+/*
+  Calibration of the analog inputs: learnt min/center/max per input
+*/
+#pragma once
+#include "Config.h"
+
+// Default hold time of the TEST+SERVICE chord to start, or stop and save, the calibration
+#define CALIB_CHORD_MS (2000)
+
+namespace Calib {
+
+void Setup();
+void Start();
+void Stop(bool save);
+void Clear();
+bool IsRunning();
+int16_t Apply(uint8_t ain, int16_t raw);
+
+}
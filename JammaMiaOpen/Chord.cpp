@@ -0,0 +1,146 @@
+/*
+  Chords
+
+  A chord is a mask of digital inputs with a window and an action. It is
+  matched on the packed inputs word with a few mask operations per chord
+  at each loop, whatever the number of inputs.
+
+  By default all inputs of the chord must be pressed within the window,
+  counted from the first one. With LongPress, the whole chord must be held
+  for the window instead. The action is pressed while the chord stays
+  complete, and fires once per press of the chord.
+
+  With Swallow, the inputs of a chord do not reach the emulated devices:
+  they are held back while the chord may still complete in its window,
+  then masked until released once the chord fired. Inputs held back are
+  reported late if the window ends without the chord. With LongPress,
+  inputs are reported until the chord fires.
+
+  A chord held when the config is reloaded waits for all its inputs to
+  be released, so that a held chord does not fire again.
+*/
+#include "Chord.h"
+#include "Tick.h"
+#include "Mapping.h"
+
+namespace Chord {
+
+// Window in hardware ticks from x10ms
+#define WINDOW_TICKS(w) ((uint16_t)(((uint32_t)(w) * 10000UL) / HWTICK_US))
+
+enum States : uint8_t {
+  // Window started
+  Started = (1<<0),
+  // Action fired, until the chord is broken
+  Fired = (1<<1),
+  // Window ended without the chord, until all inputs are released
+  Expired = (1<<2),
+};
+
+static uint8_t NbChords = 0;
+// Compiled chords, in config order
+static uint32_t Masks[NB_CHORDS];
+static uint16_t Windows[NB_CHORDS];
+static byte Options[NB_CHORDS];
+static Config::MappingType Types[NB_CHORDS];
+static byte Maps[NB_CHORDS];
+// Runtime state
+static uint8_t State[NB_CHORDS];
+static uint16_t Start[NB_CHORDS];
+// Inputs masked until released
+static uint32_t Swallowed = 0;
+// Inputs at last loop
+static uint32_t LastDin = 0;
+
+static void Action(uint8_t k, bool state) {
+  Mapping::Inject(Types[k], Maps[k], state);
+}
+
+void Setup() {
+  // Release actions of chords still held
+  for (uint8_t k = 0; k < NbChords; k++) {
+    if (State[k] & States::Fired) {
+      Action(k, false);
+    }
+  }
+  uint8_t nb = 0;
+  for (uint8_t i = 0; i < NB_CHORDS; i++) {
+    auto &chord = Config::ConfigFile.Chords[i];
+    if ((chord.Mask == 0) || (chord.Type == Config::MappingType::Nothing))
+      continue;
+    Masks[nb] = chord.Mask;
+    Windows[nb] = WINDOW_TICKS(chord.Window);
+    Options[nb] = chord.Options;
+    Types[nb] = chord.Type;
+    Maps[nb] = chord.MapTo;
+    State[nb] = (LastDin & chord.Mask) ? States::Expired : 0;
+    nb++;
+  }
+  NbChords = nb;
+}
+
+uint32_t Apply(uint32_t din) {
+  uint16_t now = Tick::Now();
+  uint32_t pending = 0;
+  LastDin = din;
+  // Released inputs are reported again
+  Swallowed &= din;
+  for (uint8_t k = 0; k < NbChords; k++) {
+    uint32_t mask = Masks[k];
+    uint32_t held = din & mask;
+    uint8_t state = State[k];
+    bool longpress = Options[k] & Config::ChordOptions::LongPress;
+
+    if (held == 0) {
+      // Chord released
+      if (state & States::Fired) {
+        Action(k, false);
+      }
+      State[k] = 0;
+      continue;
+    }
+    if (held != mask) {
+      // Chord incomplete
+      if (state & States::Fired) {
+        // Once per press of the chord
+        Action(k, false);
+        state = (state & ~States::Fired) | States::Expired;
+      }
+      if (longpress) {
+        state &= ~States::Started;
+      } else if (!(state & States::Started)) {
+        state |= States::Started;
+        Start[k] = now;
+      }
+      if ((state & States::Started) && ((uint16_t)(now - Start[k]) > Windows[k])) {
+        state |= States::Expired;
+      }
+      if ((Options[k] & Config::ChordOptions::Swallow) && !longpress && !(state & States::Expired)) {
+        pending |= held;
+      }
+      State[k] = state;
+      continue;
+    }
+    // Chord complete
+    if (!(state & (States::Fired | States::Expired))) {
+      if (!(state & States::Started)) {
+        state |= States::Started;
+        Start[k] = now;
+      }
+      bool inwindow = ((uint16_t)(now - Start[k]) <= Windows[k]);
+      if (longpress ? !inwindow : inwindow) {
+        state |= States::Fired;
+        Action(k, true);
+      } else if (!longpress) {
+        state |= States::Expired;
+      }
+    }
+    if ((state & States::Fired) && (Options[k] & Config::ChordOptions::Swallow)) {
+      Swallowed |= mask;
+    }
+    State[k] = state;
+  }
+  return din & ~(Swallowed | pending);
+}
+
+}
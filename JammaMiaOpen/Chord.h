@@ -0,0 +1,12 @@
+/*
+  Chords: actions on combinations of digital inputs
+*/
+#pragma once
+#include "Config.h"
+
+namespace Chord {
+
+void Setup();
+uint32_t Apply(uint32_t din);
+
+}
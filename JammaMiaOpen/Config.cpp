@@ -5,6 +5,18 @@
 #include <EEPROM.h>
 #include "CRC.h"
 #include "Globals.h"
+#include "Debounce.h"
+#include "Socd.h"
+#include "Chord.h"
+#include "Ramp.h"
+#include "Rotary.h"
+#include "Quadrature.h"
+#include "Adc.h"
+#include "Calib.h"
+#include "Curve.h"
+#include "Stick.h"
+#include "Mapping.h"
+#include "Turbo.h"
 
 #ifdef USE_KEYB
 #include <KeyboardNKey.h>
@@ -14,11 +26,38 @@ namespace Config {
 
 EEPROM_CONFIG ConfigFile;
 
+uint32_t DInInvertMask = 0;
+uint32_t DInEnableMask = 0xFFFFFFFF;
+
 const int EEPROM_CONFIG_START = 0x80;
 const int EEPROM_CONFIG_SIZE = sizeof(EEPROM_CONFIG);
 const int EEPROM_CONFIG_END = EEPROM_CONFIG_START + EEPROM_CONFIG_SIZE;
 
-const int EEPROM_TOTALSIZE = EEPROM_CONFIG_END;
+// Blocks outside of the config are at fixed addresses from the end of the
+// eeprom, so that a change of the config size does not move them
+
+// Macros, read step by step when played
+const int EEPROM_MACROS_SIZE = NB_MACROS * MACRO_STEPS * sizeof(MacroStep);
+const int EEPROM_MACROS_END = E2END + 1;
+const int EEPROM_MACROS_START = EEPROM_MACROS_END - EEPROM_MACROS_SIZE;
+
+// Names of inputs, only used by the configuration commands: kept out of RAM
+const int EEPROM_NAMES_SIZE = (NB_DIGITALINPUTS + NB_ANALOGINPUTS) * LENGTH_IO_NAME;
+const int EEPROM_NAMES_END = EEPROM_MACROS_START;
+const int EEPROM_NAMES_START = EEPROM_NAMES_END - EEPROM_NAMES_SIZE;
+
+// Custom response curves, outside of the config block to save RAM
+const int EEPROM_CURVES_SIZE = NB_ANALOGINPUTS * CURVE_POINTS * sizeof(uint16_t);
+const int EEPROM_CURVES_END = EEPROM_NAMES_START;
+const int EEPROM_CURVES_START = EEPROM_CURVES_END - EEPROM_CURVES_SIZE;
+
+static_assert(EEPROM_CONFIG_END <= EEPROM_CURVES_START, "Config does not fit in eeprom");
+
+const int EEPROM_TOTALSIZE = EEPROM_MACROS_END;
+
+// Background save running, and its next byte
+static bool Saving = false;
+static int SaveCursor = 0;
 
 int SaveConfigToEEPROM() {
   if (EEPROM.length() < EEPROM_TOTALSIZE) {
@@ -30,44 +69,162 @@ int SaveConfigToEEPROM() {
   byte crc8 = CRC::crc8(pBlock + 1, EEPROM_CONFIG_SIZE - 1);
   // Update CRC in record
   ConfigFile.CRC8 = crc8;
-  // Write record to EEPROM
+  // Write record to EEPROM, only changed bytes
   for (int i = 0; i < EEPROM_CONFIG_SIZE; i++) {
-    EEPROM.write(EEPROM_CONFIG_START + i, pBlock[i]);
+    EEPROM.update(EEPROM_CONFIG_START + i, pBlock[i]);
   }
+  Saving = false;
   return 1;
 }
 
+// Save the configuration from the main loop (see RunBackgroundSave),
+// without stalling it for the eeprom write time
+void SaveConfigInBackground() {
+  ConfigFile.CRC8 = CRC::crc8((byte*)&ConfigFile + 1, EEPROM_CONFIG_SIZE - 1);
+  SaveCursor = 0;
+  Saving = true;
+}
+
+// Write at most one changed byte of a background save, when the eeprom is ready
+void RunBackgroundSave() {
+  if (!Saving || !eeprom_is_ready()) {
+    return;
+  }
+  byte* pBlock = (byte*)&ConfigFile;
+  for (; SaveCursor < EEPROM_CONFIG_SIZE; SaveCursor++) {
+    if (EEPROM.read(EEPROM_CONFIG_START + SaveCursor) != pBlock[SaveCursor]) {
+      EEPROM.write(EEPROM_CONFIG_START + SaveCursor, pBlock[SaveCursor]);
+      SaveCursor++;
+      return;
+    }
+  }
+  Saving = false;
+  // Config changed while saving: save again
+  if (CRC::crc8(pBlock + 1, EEPROM_CONFIG_SIZE - 1) != ConfigFile.CRC8) {
+    SaveConfigInBackground();
+  }
+}
+
 int LoadConfigFromEEPROM() {
   if (EEPROM.length() < EEPROM_TOTALSIZE) {
     return -1;
   }
-  // Pointer to a new record on MCU stack
-  EEPROM_CONFIG newCfg;
-  byte* pBlock = (byte*)&newCfg;
-  // Read new record from EEPROM
-  for (int i = 0; i < EEPROM_CONFIG_SIZE; i++) {
-    pBlock[i] = EEPROM.read(EEPROM_CONFIG_START + i);
+  // Compute CRC8 of the record in EEPROM, to detect wrong eeprom data
+  // without a copy of the record on the MCU stack
+  byte crc8 = 0;
+  for (int i = 1; i < EEPROM_CONFIG_SIZE; i++) {
+    byte b = EEPROM.read(EEPROM_CONFIG_START + i);
+    crc8 = CRC::crc8(&b, 1, crc8);
   }
-  // Compute CRC8 to detect wrong eeprom data
-  byte crc8 = CRC::crc8(pBlock + 1, EEPROM_CONFIG_SIZE - 1);
   // Check CRC match?
-  if (crc8 != newCfg.CRC8) {
+  if (crc8 != EEPROM.read(EEPROM_CONFIG_START)) {
     // Wrong CRC
     return -2;
   }
-  // Ok, store new config
-  ConfigFile = newCfg;
+  // Ok, read new config
+  byte* pBlock = (byte*)&ConfigFile;
+  for (int i = 0; i < EEPROM_CONFIG_SIZE; i++) {
+    pBlock[i] = EEPROM.read(EEPROM_CONFIG_START + i);
+  }
+  UpdateRuntimeConfig();
   return 1;
 }
 
+// Read custom response curve of an analog input
+void LoadCurve(uint8_t ain, uint16_t points[CURVE_POINTS]) {
+  int addr = EEPROM_CURVES_START + ain * CURVE_POINTS * sizeof(uint16_t);
+  for (uint8_t k = 0; k < CURVE_POINTS; k++) {
+    EEPROM.get(addr + k * sizeof(uint16_t), points[k]);
+  }
+}
+
+// Write custom response curve of an analog input
+void SaveCurve(uint8_t ain, const uint16_t points[CURVE_POINTS]) {
+  int addr = EEPROM_CURVES_START + ain * CURVE_POINTS * sizeof(uint16_t);
+  for (uint8_t k = 0; k < CURVE_POINTS; k++) {
+    EEPROM.put(addr + k * sizeof(uint16_t), points[k]);
+  }
+}
+
+// Write name of an input (see NAME_IO_AIN), padded with 0
+void SaveName(uint8_t io, const char *name) {
+  int addr = EEPROM_NAMES_START + io * LENGTH_IO_NAME;
+  uint8_t len = strnlen(name, LENGTH_IO_NAME);
+  for (uint8_t k = 0; k < LENGTH_IO_NAME; k++) {
+    EEPROM.update(addr + k, (k < len) ? name[k] : 0);
+  }
+}
+
+// Read one step of a macro
+void LoadMacroStep(uint8_t macro, uint8_t step, MacroStep &macrostep) {
+  EEPROM.get(EEPROM_MACROS_START + (macro * MACRO_STEPS + step) * sizeof(MacroStep), macrostep);
+  // Erased eeprom reads as 0xFF: end of macro
+  if (macrostep.Action == 0xFF) {
+    macrostep.Action = MappingType::Nothing;
+  }
+}
+
+// Write one step of a macro
+void SaveMacroStep(uint8_t macro, uint8_t step, const MacroStep &macrostep) {
+  EEPROM.put(EEPROM_MACROS_START + (macro * MACRO_STEPS + step) * sizeof(MacroStep), macrostep);
+}
+
+// Recompute runtime tables from the configuration, to be called after
+// any change of the configuration
+void UpdateRuntimeConfig() {
+  uint32_t invert = 0;
+  uint32_t enable = 0;
+  for (uint8_t i = 0; i < NB_DIGITALINPUTS; i++) {
+    byte options = ConfigFile.DigitalInB[i].Options;
+    if (options & DInOptions::InvertedLogic) {
+      invert |= (uint32_t)1 << i;
+    }
+    if (!(options & DInOptions::Disabled)) {
+      enable |= (uint32_t)1 << i;
+    }
+  }
+  // MCU inputs 28..31 replaced by encoders
+  Quadrature::Setup();
+  enable &= ~((uint32_t)Quadrature::UsedDInMask() << 28);
+  DInInvertMask = invert;
+  DInEnableMask = enable;
+  Debounce::Setup();
+  Rotary::Setup();
+  Socd::Setup();
+  Chord::Setup();
+  Turbo::Setup();
+  Ramp::Setup();
+  Adc::Configure();
+  Calib::Setup();
+  Curve::Setup();
+  Stick::Setup();
+  Mapping::Compile();
+}
+
 const char PROGMEM sSPC[] = " ";
 
-// din DIN TYPE MAP SHIFTEDMAP NAME
+// Name of an input (see NAME_IO_AIN) from eeprom, not null-terminated when using all LENGTH_IO_NAME chars
+void PrintName(uint8_t io) {
+  int addr = EEPROM_NAMES_START + io * LENGTH_IO_NAME;
+  for (uint8_t k = 0; k < LENGTH_IO_NAME; k++) {
+    char c = EEPROM.read(addr + k);
+    // Erased eeprom reads as 0xFF
+    if ((c == 0) || (c == (char)0xFF))
+      break;
+    Serial.write(c);
+  }
+}
+
+// din DIN TYPE MAP SHIFTEDMAP NAME OPT DEB TURBO LAYER2 LAYER3
 // DIN: digital input number
 // TYPE: type value
 // MAP: map value
-// SHIFTEDMAP: shifted map value (0 for none)
+// SHIFTEDMAP: shifted map value, in layer 1 (0 for none)
 // NAME: Name of input (limited to 3 char)
+// OPT: options (see DInOptions)
+// DEB: debounce time in ms
+// TURBO: autofire rate and duty cycle
+// LAYER2/LAYER3: map value in layers 2 and 3 (0 for same as MAP)
 void PrintDInConfig(int i) {
   Serial.print(F("Mdin "));
   Serial.print(i, HEX);
@@ -76,11 +233,22 @@ void PrintDInConfig(int i) {
   Serial.print((__FlashStringHelper*)sSPC);
   Serial.print(ConfigFile.DigitalInB[i].MapTo, HEX);
   Serial.print((__FlashStringHelper*)sSPC);
-  Serial.print(ConfigFile.DigitalInB[i].MapToShifted, HEX);
+  Serial.print(ConfigFile.DigitalInB[i].MapToLayer[0], HEX);
+  Serial.print((__FlashStringHelper*)sSPC);
+  PrintName(i);
+  Serial.print((__FlashStringHelper*)sSPC);
+  Serial.print(ConfigFile.DigitalInB[i].Options, HEX);
   Serial.print((__FlashStringHelper*)sSPC);
-  Serial.println(ConfigFile.DigitalInB[i].Name);
+  Serial.print(ConfigFile.DigitalInB[i].DebounceMs, HEX);
+  Serial.print((__FlashStringHelper*)sSPC);
+  Serial.print(ConfigFile.DigitalInB[i].Turbo, HEX);
+  for (uint8_t l = 1; l < NB_LAYERS - 1; l++) {
+    Serial.print((__FlashStringHelper*)sSPC);
+    Serial.print(ConfigFile.DigitalInB[i].MapToLayer[l], HEX);
+  }
+  Serial.println();
 }
-// ain AIN TYPE POS NEG DMIN DMAX NAME
+// ain AIN TYPE POS NEG DMIN DMAX NAME FILT THR HYST OPT CURVE SAT
 // AIN: analog input axes number
 // TYPE: type value
 // POS: map value when going positive
@@ -88,6 +256,12 @@ void PrintDInConfig(int i) {
 // DMIN: dead zone min value if hat or button, usually 60
 // DMAX: dead zone max value if hat or button, usually 80
 // NAME: Name of analog input (limited to 3 char)
+// FILT: oversampling and filter (see AInFilters)
+// THR: minimum change before an axis is reported again
+// HYST: hysteresis around dead zone limits
+// OPT: options (see AInOptions)
+// CURVE: response curve (see AInCurves)
+// SAT: saturation at both ends
 void PrintAInConfig(int i) {
   Serial.print(F("Main "));
   Serial.print(i, HEX);
@@ -102,7 +276,111 @@ void PrintAInConfig(int i) {
   Serial.print((__FlashStringHelper*)sSPC);
   Serial.print(ConfigFile.AnalogInDB[i].DeadzoneMax, HEX);
   Serial.print((__FlashStringHelper*)sSPC);
-  Serial.println(ConfigFile.DigitalInB[i].Name);
+  PrintName(NAME_IO_AIN(i));
+  Serial.print((__FlashStringHelper*)sSPC);
+  Serial.print(ConfigFile.AnalogInDB[i].Filter, HEX);
+  Serial.print((__FlashStringHelper*)sSPC);
+  Serial.print(ConfigFile.AnalogInDB[i].Threshold, HEX);
+  Serial.print((__FlashStringHelper*)sSPC);
+  Serial.print(ConfigFile.AnalogInDB[i].Hysteresis, HEX);
+  Serial.print((__FlashStringHelper*)sSPC);
+  Serial.print(ConfigFile.AnalogInDB[i].Options, HEX);
+  Serial.print((__FlashStringHelper*)sSPC);
+  Serial.print(ConfigFile.AnalogInDB[i].Curve, HEX);
+  Serial.print((__FlashStringHelper*)sSPC);
+  Serial.println(ConfigFile.AnalogInDB[i].Saturation, HEX);
+}
+
+// socd GROUP UP DOWN LEFT RIGHT POLICY
+// GROUP: SOCD group number
+// UP/DOWN/LEFT/RIGHT: digital input index +1 of each direction, 0 for none
+// POLICY: see SOCDPolicies
+void PrintSOCDConfig(int i) {
+  Serial.print(F("Msocd "));
+  Serial.print(i, HEX);
+  Serial.print((__FlashStringHelper*)sSPC);
+  Serial.print(ConfigFile.SOCDGroups[i].Up, HEX);
+  Serial.print((__FlashStringHelper*)sSPC);
+  Serial.print(ConfigFile.SOCDGroups[i].Down, HEX);
+  Serial.print((__FlashStringHelper*)sSPC);
+  Serial.print(ConfigFile.SOCDGroups[i].Left, HEX);
+  Serial.print((__FlashStringHelper*)sSPC);
+  Serial.print(ConfigFile.SOCDGroups[i].Right, HEX);
+  Serial.print((__FlashStringHelper*)sSPC);
+  Serial.println(ConfigFile.SOCDGroups[i].Policy, HEX);
+}
+
+// chord CHORD MASK WIN OPT TYPE MAP
+// CHORD: chord number
+// MASK: digital inputs of the chord, bit i for input i
+// WIN: window (x10ms)
+// OPT: options (see ChordOptions)
+// TYPE: action type, same as a digital input
+// MAP: action map value, same as a digital input
+void PrintChordConfig(int i) {
+  Serial.print(F("Mchord "));
+  Serial.print(i, HEX);
+  Serial.print((__FlashStringHelper*)sSPC);
+  Serial.print(ConfigFile.Chords[i].Mask, HEX);
+  Serial.print((__FlashStringHelper*)sSPC);
+  Serial.print(ConfigFile.Chords[i].Window, HEX);
+  Serial.print((__FlashStringHelper*)sSPC);
+  Serial.print(ConfigFile.Chords[i].Options, HEX);
+  Serial.print((__FlashStringHelper*)sSPC);
+  Serial.print(ConfigFile.Chords[i].Type, HEX);
+  Serial.print((__FlashStringHelper*)sSPC);
+  Serial.println(ConfigFile.Chords[i].MapTo, HEX);
+}
+
+// fan FAN DIN TYPE MAP
+// FAN: fan-out number
+// DIN: digital input index +1, 0 for none
+// TYPE/MAP: extra target, same as a digital input
+void PrintFanOutConfig(int i) {
+  Serial.print(F("Mfan "));
+  Serial.print(i, HEX);
+  Serial.print((__FlashStringHelper*)sSPC);
+  Serial.print(ConfigFile.FanOuts[i].DIn, HEX);
+  Serial.print((__FlashStringHelper*)sSPC);
+  Serial.print(ConfigFile.FanOuts[i].Type, HEX);
+  Serial.print((__FlashStringHelper*)sSPC);
+  Serial.println(ConfigFile.FanOuts[i].MapTo, HEX);
+}
+
+// rot ROT DIN OPT POS TYPE MAP CCW
+// ROT: rotary number
+// DIN: first digital input index +1, 0 for none
+// OPT: number of inputs and options (see RotaryOptions)
+// POS: number of positions
+// TYPE/MAP/CCW: joy axis in MAP, or step target type and clockwise/counter-clockwise map values
+void PrintRotaryConfig(int i) {
+  Serial.print(F("Mrot "));
+  Serial.print(i, HEX);
+  Serial.print((__FlashStringHelper*)sSPC);
+  Serial.print(ConfigFile.Rotaries[i].DIn, HEX);
+  Serial.print((__FlashStringHelper*)sSPC);
+  Serial.print(ConfigFile.Rotaries[i].Options, HEX);
+  Serial.print((__FlashStringHelper*)sSPC);
+  Serial.print(ConfigFile.Rotaries[i].Positions, HEX);
+  Serial.print((__FlashStringHelper*)sSPC);
+  Serial.print(ConfigFile.Rotaries[i].Type, HEX);
+  Serial.print((__FlashStringHelper*)sSPC);
+  Serial.print(ConfigFile.Rotaries[i].MapTo, HEX);
+  Serial.print((__FlashStringHelper*)sSPC);
+  Serial.println(ConfigFile.Rotaries[i].MapToCCW, HEX);
+}
+
+// enc ENC MAP SCALE
+// ENC: encoder number
+// MAP: mouse axis, 0 for none
+// SCALE: mouse counts per edge (x1/16)
+void PrintEncoderConfig(int i) {
+  Serial.print(F("Menc "));
+  Serial.print(i, HEX);
+  Serial.print((__FlashStringHelper*)sSPC);
+  Serial.print(ConfigFile.Encoders[i].MapTo, HEX);
+  Serial.print((__FlashStringHelper*)sSPC);
+  Serial.println(ConfigFile.Encoders[i].Scale, HEX);
 }
 
 void PrintConfig() {
@@ -116,6 +394,21 @@ void PrintConfig() {
   for (uint8_t i = 0; i < sizeof(ConfigFile.AnalogInDB) / sizeof(ConfigFile.AnalogInDB[0]); i++) {
     PrintAInConfig(i);
   }
+  for (uint8_t i = 0; i < NB_SOCD_GROUPS; i++) {
+    PrintSOCDConfig(i);
+  }
+  for (uint8_t i = 0; i < NB_CHORDS; i++) {
+    PrintChordConfig(i);
+  }
+  for (uint8_t i = 0; i < NB_FANOUTS; i++) {
+    PrintFanOutConfig(i);
+  }
+  for (uint8_t i = 0; i < NB_ROTARIES; i++) {
+    PrintRotaryConfig(i);
+  }
+  for (uint8_t i = 0; i < NB_ENCODERS; i++) {
+    PrintEncoderConfig(i);
+  }
 }
 // Offset to get P2 digital inputs
 #define P2_DIN_OFFSET (14)
@@ -128,6 +421,36 @@ void ResetConfig() {
   ConfigFile.KeybLayout = 0;  // Layout en-US
   //ConfigFile.KeybLayout = 1;  // Layout fr-FR
 
+  // Eager debounce for all inputs
+  for (uint8_t i = 0; i < NB_DIGITALINPUTS; i++) {
+    ConfigFile.DigitalInB[i].DebounceMs = DEFAULT_DEBOUNCE_MS;
+  }
+  // Oversampling and filtering of analog inputs
+  for (uint8_t i = 0; i < NB_ANALOGINPUTS; i++) {
+    ConfigFile.AnalogInDB[i].Filter = DEFAULT_AIN_FILTER;
+    ConfigFile.AnalogInDB[i].Threshold = DEFAULT_AIN_THRESHOLD;
+    ConfigFile.AnalogInDB[i].Hysteresis = DEFAULT_AIN_HYSTERESIS;
+  }
+  // Mouse moves
+  ConfigFile.MouseSpeed = DEFAULT_MOUSE_SPEED;
+  ConfigFile.MouseAccel = DEFAULT_MOUSE_ACCEL;
+  // Lightgun off-screen rule
+  ConfigFile.GunOffscreen = DEFAULT_GUN_OFFSCREEN;
+  // SOCD groups on P1/P2 sticks directions (index+1), cleaning off
+  for (uint8_t p = 0; p < 2; p++) {
+    ConfigFile.SOCDGroups[p].Up = 8 + 1 + p * P2_DIN_OFFSET;
+    ConfigFile.SOCDGroups[p].Down = 9 + 1 + p * P2_DIN_OFFSET;
+    ConfigFile.SOCDGroups[p].Left = 10 + 1 + p * P2_DIN_OFFSET;
+    ConfigFile.SOCDGroups[p].Right = 11 + 1 + p * P2_DIN_OFFSET;
+    ConfigFile.SOCDGroups[p].Policy = SOCDPolicies::Off;
+  }
+  // TEST+SERVICE (din 28 and 29) held to start, or stop and save, the calibration
+  ConfigFile.Chords[0].Mask = ((uint32_t)1 << 28) | ((uint32_t)1 << 29);
+  ConfigFile.Chords[0].Window = CALIB_CHORD_MS / 10;
+  ConfigFile.Chords[0].Options = ChordOptions::LongPress;
+  ConfigFile.Chords[0].Type = MappingType::System;
+  ConfigFile.Chords[0].MapTo = SystemActions::CalibrationToggle;
+
 #if defined(USE_JOY) && !defined(USE_KEYB) && !defined(USE_MOUSE)
   // Joystick only
   Config::ConfigFile.EmulationMode = Config::EmulationModes::Joystick;
@@ -179,8 +502,8 @@ void ResetConfig() {
     ConfigFile.AnalogInDB[i].MapToPos = i % 2 + ((i < 2) ? 0 : (byte)(1 << 7));  // X/Y/Z
     ConfigFile.AnalogInDB[i].MapToNeg = 0;                                       // X/Y/Z
 
-    ConfigFile.AnalogInDB[i].DeadzoneMin = 0x60;  // dead zone min (x4) to detect axis leave center zone
-    ConfigFile.AnalogInDB[i].DeadzoneMax = 0xA0;  // dead zone max (x4) to detect axis leave for center zone
+    ConfigFile.AnalogInDB[i].DeadzoneMin = 0x7C;  // small dead band (x16) around axis center
+    ConfigFile.AnalogInDB[i].DeadzoneMax = 0x84;  // small dead band (x16) around axis center
   }
 #endif
 
@@ -192,13 +515,13 @@ void ResetConfig() {
   // Emulated keys for all digital inputs
   for (uint8_t i = 0; i < sizeof(ConfigFile.DigitalInB) / sizeof(ConfigFile.DigitalInB[0]); i++) {
     ConfigFile.DigitalInB[i].Type = MappingType::Key;
-    ConfigFile.DigitalInB[i].MapToShifted = 0;  // default to no alternative mapping
+    ConfigFile.DigitalInB[i].MapToLayer[0] = 0;  // default to no alternative mapping
   }
 
   // Emulated keys, using MAME default layout
   // Map Player1 on MCP1
   ConfigFile.DigitalInB[0].MapTo = KEY_LEFT_CTRL;       // P1-But1
-  ConfigFile.DigitalInB[0].MapToShifted = '5';          // P1-But1 shifted
+  ConfigFile.DigitalInB[0].MapToLayer[0] = '5';          // P1-But1 shifted
   ConfigFile.DigitalInB[1].MapTo = KEY_LEFT_ALT;        // P1-But2
   ConfigFile.DigitalInB[2].MapTo = ' ';                 // P1-But3
   ConfigFile.DigitalInB[3].MapTo = KEY_LEFT_SHIFT;      // P1-But4
@@ -208,13 +531,13 @@ void ResetConfig() {
   ConfigFile.DigitalInB[7].MapTo = 'v';                 // P1-But8
   
   ConfigFile.DigitalInB[8].MapTo = KEY_UP_ARROW;        // P1-Up
-  ConfigFile.DigitalInB[8].MapToShifted = '~';          // P1-Up shifted
+  ConfigFile.DigitalInB[8].MapToLayer[0] = '~';          // P1-Up shifted
   ConfigFile.DigitalInB[9].MapTo = KEY_DOWN_ARROW;      // P1-Down
-  ConfigFile.DigitalInB[9].MapToShifted = 'p';          // P1-Down shifted
+  ConfigFile.DigitalInB[9].MapToLayer[0] = 'p';          // P1-Down shifted
   ConfigFile.DigitalInB[10].MapTo = KEY_LEFT_ARROW;     // P1-Left
-  ConfigFile.DigitalInB[10].MapToShifted = KEY_RETURN;  // P1-Left shifted
+  ConfigFile.DigitalInB[10].MapToLayer[0] = KEY_RETURN;  // P1-Left shifted
   ConfigFile.DigitalInB[11].MapTo = KEY_RIGHT_ARROW;    // P1-Right
-  ConfigFile.DigitalInB[11].MapToShifted = KEY_TAB;     // P1-Right shifted
+  ConfigFile.DigitalInB[11].MapToLayer[0] = KEY_TAB;     // P1-Right shifted
   ConfigFile.DigitalInB[12].MapTo = '5';                // P1-COIN1
   ConfigFile.DigitalInB[13].MapTo = '1';                // P1-START1
 
@@ -234,7 +557,7 @@ void ResetConfig() {
   ConfigFile.DigitalInB[P2_DIN_OFFSET+11].MapTo = 'g';             // P2-Right
   ConfigFile.DigitalInB[P2_DIN_OFFSET+12].MapTo = '6';             // P2-COIN2
   ConfigFile.DigitalInB[P2_DIN_OFFSET+13].MapTo = '2';             // P2-START2
-  ConfigFile.DigitalInB[P2_DIN_OFFSET+13].MapToShifted = KEY_ESC;  // P2-START2 shifted
+  ConfigFile.DigitalInB[P2_DIN_OFFSET+13].MapToLayer[0] = KEY_ESC;  // P2-START2 shifted
 
   // Map Service buttons that are on MCU pins
   ConfigFile.DigitalInB[P2_DIN_OFFSET*2+0].MapTo = KEY_F2;  // 'F2' for TEST
@@ -245,8 +568,8 @@ void ResetConfig() {
   // 4x analog sticks on analog inputs screw terminals mapped to KEYPAD
   for (uint8_t i = 0; i < sizeof(ConfigFile.AnalogInDB) / sizeof(ConfigFile.AnalogInDB[0]); i++) {
     ConfigFile.AnalogInDB[i].Type = MappingType::Key;
-    ConfigFile.AnalogInDB[i].DeadzoneMin = 0x60;  // dead zone min (x4) to detect axis leave center zone
-    ConfigFile.AnalogInDB[i].DeadzoneMax = 0xA0;  // dead zone max (x4) to detect axis leave for center zone
+    ConfigFile.AnalogInDB[i].DeadzoneMin = 0x60;  // dead zone min (x16) to detect axis leave center zone
+    ConfigFile.AnalogInDB[i].DeadzoneMax = 0xA0;  // dead zone max (x16) to detect axis leave for center zone
   }
   /*
   ConfigFile.AnalogInDB[0].MapToPos = KEY_KP_8;
@@ -311,8 +634,8 @@ void ResetConfig() {
     ConfigFile.AnalogInDB[i].MapToPos = i % 2 + ((i < 2) ? 0 : (byte)(1 << 7));  // X/Y/Z
     ConfigFile.AnalogInDB[i].MapToNeg = 0;                                       // X/Y/Z
 
-    ConfigFile.AnalogInDB[i].DeadzoneMin = 0x60;  // dead zone min (x4) to detect axis leave center zone
-    ConfigFile.AnalogInDB[i].DeadzoneMax = 0xA0;  // dead zone max (x4) to detect axis leave for center zone
+    ConfigFile.AnalogInDB[i].DeadzoneMin = 0x7C;  // small dead band (x16) around axis center
+    ConfigFile.AnalogInDB[i].DeadzoneMax = 0x84;  // small dead band (x16) around axis center
   }
 #endif
 
@@ -348,6 +671,27 @@ void ResetConfig() {
   
 #endif
 
+#if defined(USE_GUN) && !defined(USE_JOY) && !defined(USE_KEYB) && !defined(USE_MOUSE)
+  // Lightgun only
+  Config::ConfigFile.EmulationMode = Config::EmulationModes::Lightgun;
+  // 5x Gun Buttons, trigger and reload first
+  for (uint8_t i = 0; i < 5; i++) {
+    // P1
+    ConfigFile.DigitalInB[i].Type = MappingType::Gun;
+    ConfigFile.DigitalInB[i].MapTo = (byte)i;
+    // P2
+    ConfigFile.DigitalInB[i + P2_DIN_OFFSET].Type = MappingType::Gun;
+    ConfigFile.DigitalInB[i + P2_DIN_OFFSET].MapTo = (byte)i + (byte)(1 << 7);
+  }
+  // X/Y position: P1 on AIN 0/1, P2 on AIN 2/3
+  for (uint8_t i = 0; i < NB_ANALOGINPUTS; i++) {
+    ConfigFile.AnalogInDB[i].Type = MappingType::Gun;
+    ConfigFile.AnalogInDB[i].MapToPos = (byte)(1 << (i & 1)) + (byte)((i >> 1) << 7);
+  }
+#endif
+
+
+  UpdateRuntimeConfig();
 
 #ifdef DEBUG_PRINTF
   PrintConfig();
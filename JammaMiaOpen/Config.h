@@ -9,6 +9,19 @@
 #define USE_KEYB
 #define USE_JOY
 //#define USE_MOUSE
+// Lightguns as absolute pointers
+//#define USE_GUN
+
+// MCP23017 inputs are only read over I2C when the shared INT line reports a change
+#define USE_MCP_INTERRUPT
+// Short pulses latched by the MCP23017 (INTF/INTCAP) are reported even if released
+// before the next read. Needs USE_MCP_INTERRUPT.
+#define USE_MCP_CAPTURE
+// Dedicated register-level TWI driver for the MCP23017 instead of Adafruit MCP23017/BusIO/Wire
+#define USE_MCP_TWI_DRIVER
+// Expanders are scanned in background by the TWI interrupt while the loop processes inputs.
+// Needs USE_MCP_TWI_DRIVER.
+#define USE_MCP_ASYNC_SCAN
 
 //-----------------------------------------------------------------------------
 // Constants and enums
@@ -34,6 +47,16 @@
 #define TICK_HZ (1000.0f / (float)TICK_MS)
 #define TICK_KHZ (1.0f / (float)TICK_MS)
 
+#if defined(USE_MCP_CAPTURE) && !defined(USE_MCP_INTERRUPT)
+#error "USE_MCP_CAPTURE needs USE_MCP_INTERRUPT"
+#endif
+#if defined(USE_MCP_ASYNC_SCAN) && !defined(USE_MCP_TWI_DRIVER)
+#error "USE_MCP_ASYNC_SCAN needs USE_MCP_TWI_DRIVER"
+#endif
+
+// Safety re-read period of the MCP23017 when using interrupt-on-change (in us)
+#define MCP_SAFETY_REFRESH_US (20000UL)
+
 // Periode blink
 #define BLINK_HZ (2)
 // Durée blink en ms
@@ -67,6 +90,10 @@ enum EmulationModes : byte {
   Mouse = 4,
   // Emulation of 2 mices + keyboard : X/Y axes, 3 buttons + other buttons as keyboard keys
   MouseAndKeyboard = 5,
+  // Emulation of 2 lightguns : absolute X/Y position, trigger/reload buttons
+  Lightgun = 6,
+  // Emulation of 2 lightguns + keyboard : absolute X/Y position, trigger/reload + other buttons as keyboard keys
+  LightgunAndKeyboard = 7,
 };
 
 
@@ -83,6 +110,13 @@ enum EmulationModes : byte {
 // 4 pwm on pro-micro
 #define NB_ANALOGOUTPUTS (4)
 
+// Analog inputs values are scaled to 12 bits, whatever the oversampling
+#define AIN_BITS (12)
+#define AIN_MAX_VAL ((1 << AIN_BITS) - 1)
+#define AIN_CENTERED_VAL (AIN_MAX_VAL >> 1)
+// Maximum oversampling: 4^2 = 16x for 12 bits out of the 10-bit ADC
+#define AIN_MAX_OVERSAMPLING (2)
+
 // 4 HAT max per jostick, see HATDirections
 #define MAX_HAT (4)
 
@@ -102,8 +136,192 @@ enum MappingType : byte {
   MouseAxis = 5,
   // mouse button left/right/middle/prev/next
   MouseButton = 6,
+  // Timed macro, mapping value is the macro number
+  Macro = 7,
+  // Board action, mapping value is a SystemActions
+  System = 8,
+  // Layer key, mapping value is a layer number and LayerKeys options
+  Layer = 9,
+  // Axis ramped while held, mapping value is an axis and RampOptions
+  Ramp = 10,
+  // Lightgun absolute X/Y position from analog, or button (trigger, reload...) from digital
+  Gun = 11,
+};
+
+// Mapping value of a ramp: player in bit 7, axis in bits 2..0 (joy axis index or mouse W/Y/X bitmask)
+enum RampOptions : byte {
+  // Ramp toward the negative end
+  RampNegative = (1<<3),
+  // Joy axis rests at the end opposite to the ramp (pedal) instead of the center
+  RampFullTravel = (1<<5),
+  // Mouse axis velocity instead of joy axis
+  RampMouse = (1<<6),
+};
+
+// Mapping layers, layer 0 being the normal map
+#define NB_LAYERS (4)
+
+// Mapping value of a layer key
+enum LayerKeys : byte {
+  // Layer number 1..3
+  LayerNumberMask = 0x03,
+  // Press toggles the layer, instead of holding it while pressed
+  LayerToggle = 0x80,
+};
+
+// Board actions
+enum SystemActions : byte {
+  // Start, or stop and save, the calibration of analog inputs
+  CalibrationToggle = 0,
+};
+
+// Fan-out: extra targets of digital inputs
+#define NB_FANOUTS (8)
+
+// Non-volatile (eeprom) fan-out config
+typedef struct __attribute__((__packed__)) {
+  // Digital input index +1, 0 for none
+  uint8_t DIn;
+  // Extra target, same as a digital input
+  MappingType Type;
+  byte MapTo;
+} FanOutConfig;
+
+// Rotary joysticks: groups of contiguous digital inputs decoded into a position
+#define NB_ROTARIES (2)
+
+enum RotaryOptions : byte {
+  // Number of digital inputs of the group, 2..5 gray coded or 2..12 one-hot
+  RotaryInputsMask = 0x0F,
+  // One input per position instead of gray code
+  RotaryOneHot = (1<<4),
+  // Clockwise/counter-clockwise step events instead of an absolute axis
+  RotarySteps = (1<<5),
+};
+
+// Non-volatile (eeprom) rotary config
+typedef struct __attribute__((__packed__)) {
+  // First digital input index +1, 0 for none
+  uint8_t DIn;
+  // Options, see RotaryOptions
+  byte Options;
+  // Number of positions, usually 12 or 24
+  uint8_t Positions;
+  // Absolute axis: joy axis in MapTo, type unused
+  // Steps: target type, clockwise and counter-clockwise mapping values
+  MappingType Type;
+  byte MapTo;
+  byte MapToCCW;
+} RotaryConfig;
+
+// Quadrature encoders on MCU pins, see Quadrature
+#define NB_ENCODERS (2)
+// Default scale: one mouse count per edge
+#define DEFAULT_ENCODER_SCALE (16)
+
+// Non-volatile (eeprom) encoder config
+typedef struct __attribute__((__packed__)) {
+  // Mouse axis: player in bit 7, negative in bit 3, W/Y/X bitmask in bits 2..0, 0 for none
+  byte MapTo;
+  // Mouse counts per edge (x1/16), 0 for default
+  uint8_t Scale;
+} EncoderConfig;
+
+// Mouse acceleration of held digital moves, from 1/8 of maximum speed
+enum MouseAccelOptions : byte {
+  // Time to maximum speed (x16ms)
+  MouseAccelTimeMask = 0x7F,
+  // Quadratic instead of linear speed increase
+  MouseAccelQuadratic = (1<<7),
+};
+// Default mouse: 1000 counts/s, reached in 512ms
+#define DEFAULT_MOUSE_SPEED (0x10)
+#define DEFAULT_MOUSE_ACCEL (0x20)
+
+// Mapping value of a lightgun: player in bit 7
+// - analog input: inverted axis in bit 3, X (1) or Y (2) in bits 1..0
+// - digital input: button index 0..4, trigger being 0 and reload 1
+
+// Lightgun off-screen rule, see Gun
+enum GunOffscreenOptions : byte {
+  // Margin (x16) at both ends of the axes where the gun is off-screen, 0 disables the rule
+  GunMarginMask = 0x7F,
+  // Off-screen pointer goes to the top left corner, instead of the trigger pressing reload
+  GunCorner = (1<<7),
+};
+// Default off-screen margin: 32, about 1% of the axis
+#define DEFAULT_GUN_OFFSCREEN (0x02)
+
+// Chords: combinations of digital inputs
+#define NB_CHORDS (4)
+
+enum ChordOptions : byte {
+  // Inputs of the chord are not reported while they make the chord
+  Swallow = (1<<0),
+  // Window is the time the chord must be held, instead of the time to press all its inputs
+  LongPress = (1<<1),
+};
+
+// Non-volatile (eeprom) chord config
+typedef struct __attribute__((__packed__)) {
+  // Digital inputs of the chord, bit i for input i, 0 for none
+  uint32_t Mask;
+  // Window (x10ms)
+  uint8_t Window;
+  // Options, see ChordOptions
+  byte Options;
+  // Action, same as a digital input
+  MappingType Type;
+  byte MapTo;
+} ChordConfig;
+
+// SOCD groups: opposite directions of a stick
+#define NB_SOCD_GROUPS (4)
+
+// Policy for opposite directions held together
+enum SOCDPolicies : byte {
+  // Both directions are reported
+  Off = 0,
+  // Last pressed direction wins
+  LastWins = 1,
+  // Neutral: none of the directions
+  Neutral = 2,
+  // Up wins over down, left+right is neutral
+  UpPriority = 3,
+};
+
+// Non-volatile (eeprom) SOCD group config
+typedef struct __attribute__((__packed__)) {
+  // Digital input index +1 of each direction, 0 for none
+  uint8_t Up;
+  uint8_t Down;
+  uint8_t Left;
+  uint8_t Right;
+  SOCDPolicies Policy;
+} SOCDGroupConfig;
+
+// Macros stored in eeprom
+#define NB_MACROS (8)
+#define MACRO_STEPS (8)
+
+// Actions of a macro step
+enum MacroActions : byte {
+  // bits 0..3: mapping type of the step, Nothing ends the macro, Macro continues with another macro
+  StepTypeMask = 0x0F,
+  Press = 0x40,
+  Release = 0x80,
 };
 
+// One step of a macro
+typedef struct __attribute__((__packed__)) {
+  // Type and press/release, see MacroActions
+  byte Action;
+  // Mapping value, same as MapTo of a digital input
+  byte MapTo;
+  // Delay before next step, x4ms
+  uint8_t Delay;
+} MacroStep;
+
 // Config options for keyboard or joystick emulation
 enum DInOptions : byte {
   None = 0,
@@ -113,10 +331,71 @@ enum DInOptions : byte {
   InvertedLogic = (1<<1),
   // Repeated press
   AutoFire = (1<<2),
+  // Debounce by integration (edge reported once stable) instead of eager (edge reported at once then locked)
+  DebounceIntegrate = (1<<3),
+};
+
+// Default debounce time of digital inputs in ms
+#define DEFAULT_DEBOUNCE_MS (5)
+// Default autofire: 10Hz, 50% duty cycle
+#define DEFAULT_TURBO (0x47)
+// Default ramp: 256ms attack and decay
+#define DEFAULT_RAMP (0x33)
+
+// Analog input filtering options
+enum AInFilters : byte {
+  // bits 0..1: oversampling, 4^n conversions summed and decimated (0=1x, 1=4x, 2=16x)
+  OversamplingMask = 0b11,
+  // bits 2..3: filter applied on decimated samples
+  FilterMask = 0b1100,
+  NoFilter = (0 << 2),
+  // Exponential moving average, alpha = 1/2^k
+  EMA = (1 << 2),
+  // Median of last 3 or 5 samples
+  Median3 = (2 << 2),
+  Median5 = (3 << 2),
+  // bits 4..6: k for EMA
+  EMAShiftMask = 0b1110000,
 };
 
+// Default analog filtering: 16x oversampling (12 bits) and EMA with alpha=1/4
+#define DEFAULT_AIN_FILTER (2 | AInFilters::EMA | (2 << 4))
+// Analog input options
+enum AInOptions : byte {
+  // Apply learnt CalMin/CalCenter/CalMax
+  Calibrated = 1,
+  // Let the center slowly follow the input while it rests
+  DriftTracking = 2,
+  // On an even input: processed with next input as a 2D stick (X, Y)
+  Paired = 4,
+  // On a paired input: 4-way gate (quadrants) instead of 8-way (octants)
+  Quadrant = 8,
+};
+
+// Number of points of response curves: input range split in 16 steps
+#define CURVE_POINTS (17)
+
+// Analog axis response curves
+enum AInCurves : byte {
+  // bits 0..1: type of curve
+  TypeMask = 0b11,
+  Linear = 0,
+  Expo = 1,
+  SCurve = 2,
+  // Table uploaded with $setcurve
+  Custom = 3,
+  // bits 4..7: strength of expo and S-curve, 0 (linear) .. 15
+  StrengthMask = 0xF0,
+};
+
+// Default analog report threshold and hysteresis, in AIN_BITS units
+#define DEFAULT_AIN_THRESHOLD (4)
+#define DEFAULT_AIN_HYSTERESIS (0x20)
+
 // Fixed length of an IO name
 #define LENGTH_IO_NAME (3)
+// IO index of names: digital inputs, then analog inputs
+#define NAME_IO_AIN(i) (NB_DIGITALINPUTS + (i))
 
 // Non-volatile (eeprom) digital input config, bytes field only
 typedef struct __attribute__((__packed__)) {
@@ -126,10 +405,15 @@ typedef struct __attribute__((__packed__)) {
   // For axis and buttons, the 7th MSB (0b10000000) gives the player selection P1-P2, bits 6 to 0 are axis or button index
   // For HAT switch, the 7thMSB gives the player selection P1-P2, 5&6th gives the hat switch number, 3 to 0 gives the direction
   byte MapTo;
-  // Index of keyscan code when using shifted/alternative map (0 being not used/none)
-  byte MapToShifted;
-  // Optional name
-  char Name[LENGTH_IO_NAME];
+  // Map value in layers 1..3, layer 1 being the shifted/alternative map (0 for same as MapTo)
+  byte MapToLayer[NB_LAYERS - 1];
+  // Options, see DInOptions
+  byte Options;
+  // Debounce time in ms: lockout after an edge (eager) or time to be stable (integrating)
+  uint8_t DebounceMs;
+  // Autofire rate (bits 4..7, (n+1)*2 Hz) and duty cycle (bits 0..3, (n+1)/16), 0 for default
+  // For a ramp: attack (bits 4..7) and decay (bits 0..3) time to full scale, (n+1)*64ms, 0 for default
+  byte Turbo;
 } DigitalInputConfig;
 
 // Non-volatile (eeprom) analog input config, bytes field only
@@ -144,14 +428,29 @@ typedef struct __attribute__((__packed__)) {
   // For axis and buttons, the 7th MSB (0b10000000) gives the player selection P1-P2, bits 6 to 0 are axis or button index
   // For HAT switch, the 7thMSB gives the player selection P1-P2, 5&6th gives the hat switch number, 3 to 0 gives the direction
   byte MapToNeg;
-  // Analog dead zone min/max (x4) for center zone of analog values, 0 (min) .. 0xFF (max)
+  // Analog dead zone min/max (x16) for center zone of analog values, 0 (min) .. 0xFF (max)
   // Minimum value is usually 0x60 (center being 80)
   uint8_t DeadzoneMin;
-  // Analog dead zone min/max (x4) for center zone of analog values, 0 (min) .. 0xFF (max)
+  // Analog dead zone min/max (x16) for center zone of analog values, 0 (min) .. 0xFF (max)
   // Maximum value is usually 0x80 (center being 80)
   uint8_t DeadzoneMax;
-  // Optional name
-  char Name[LENGTH_IO_NAME];
+  // Oversampling and filter, see AInFilters
+  byte Filter;
+  // Minimum change (in AIN_BITS units) before an analog axis is reported again
+  uint8_t Threshold;
+  // Half width (in AIN_BITS units) of the hysteresis band around dead zone limits,
+  // used when an analog input drives keys, buttons or HAT directions
+  uint8_t Hysteresis;
+  // Options, see AInOptions
+  byte Options;
+  // Response curve of axes, see AInCurves
+  byte Curve;
+  // Saturation (x16) at both ends of axes: values that close to the ends give full deflection
+  uint8_t Saturation;
+  // Learnt raw values of the input, in AIN_BITS units
+  uint16_t CalMin;
+  uint16_t CalCenter;
+  uint16_t CalMax;
 } AnalogInputConfig;
 
 // Non-volatile (eeprom) whole config, bytes field only
@@ -174,22 +473,55 @@ typedef struct __attribute__((__packed__)) {
   uint8_t JoyNumberOfAxes;
   // Number of joy's HAT switch between 0..3 (MAX_HAT)
   uint8_t JoyNumberOfHAT;
-  // index of digital input +1 that is used to use shifted/alternative map. 0 means no shifted input is configured
+  // index of digital input +1 that holds layer 1 (shifted/alternative map), in addition to its own mapping. 0 means no shifted input is configured
   uint8_t ShiftInput;
+  // SOCD cleaning of sticks directions
+  SOCDGroupConfig SOCDGroups[NB_SOCD_GROUPS];
+  // Chords of digital inputs
+  ChordConfig Chords[NB_CHORDS];
+  // Extra targets of digital inputs
+  FanOutConfig FanOuts[NB_FANOUTS];
+  // Rotary joysticks
+  RotaryConfig Rotaries[NB_ROTARIES];
+  // Quadrature encoders
+  EncoderConfig Encoders[NB_ENCODERS];
+  // Mouse maximum speed of analog and digital moves, counts per USB frame (x1/16)
+  uint8_t MouseSpeed;
+  // Mouse acceleration of digital moves, see MouseAccelOptions
+  uint8_t MouseAccel;
+  // Lightgun off-screen rule, see GunOffscreenOptions
+  uint8_t GunOffscreen;
 } EEPROM_CONFIG;
 
 // ram
 extern EEPROM_CONFIG ConfigFile;
 
+// Runtime masks precomputed from DInOptions, bit i for digital input i
+extern uint32_t DInInvertMask;
+extern uint32_t DInEnableMask;
+
 //-----------------------------------------------------------------------------
 // Utilities
 //-----------------------------------------------------------------------------
 
 int SaveConfigToEEPROM();
+void SaveConfigInBackground();
+void RunBackgroundSave();
+void LoadCurve(uint8_t ain, uint16_t points[CURVE_POINTS]);
+void SaveCurve(uint8_t ain, const uint16_t points[CURVE_POINTS]);
+void SaveName(uint8_t io, const char *name);
+void LoadMacroStep(uint8_t macro, uint8_t step, MacroStep &macrostep);
+void SaveMacroStep(uint8_t macro, uint8_t step, const MacroStep &macrostep);
 int LoadConfigFromEEPROM();
 void PrintDInConfig(int);
 void PrintAInConfig(int);
+void PrintSOCDConfig(int);
+void PrintChordConfig(int);
+void PrintFanOutConfig(int);
+void PrintRotaryConfig(int);
+void PrintEncoderConfig(int);
 void PrintConfig();
 void ResetConfig();
+void UpdateRuntimeConfig();
 
 }
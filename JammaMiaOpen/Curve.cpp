@@ -0,0 +1,125 @@
+/*
+  Response curves of the analog inputs
+
+  Dead zone and saturation are applied exactly: the input is normalized
+  to -1..+1 (Q12) with a precomputed gain on each side, so the dead band
+  is flat and the ends saturate where configured. The response curve is
+  compiled in a CURVE_POINTS lookup table over the normalized range, so
+  that the hot path is a multiply and an interpolated lookup.
+
+  Curves:
+  - linear,
+  - expo: blend of u and u^3, less sensitive around the center,
+  - S-curve: blend of u and smoothstep(u), less sensitive around the center and at the ends,
+  - custom: CURVE_POINTS output values for u evenly spread from -1 to +1, stored in eeprom.
+*/
+#include "Curve.h"
+
+namespace Curve {
+
+#define Q12 (1L << 12)
+// Normalized step between 2 table points: 2*Q12/16
+#define CURVE_STEP_BITS (12 - 3)
+
+int16_t ThresholdNeg[NB_ANALOGINPUTS];
+int16_t ThresholdPos[NB_ANALOGINPUTS];
+// Output values for u = -Q12, -Q12+512, .. Q12
+static int16_t LUT[NB_ANALOGINPUTS][CURVE_POINTS];
+// Input span from dead zone to saturation, and its Q12 gain (Q16)
+static int16_t SpanNeg[NB_ANALOGINPUTS];
+static int16_t SpanPos[NB_ANALOGINPUTS];
+static uint32_t GainNeg[NB_ANALOGINPUTS];
+static uint32_t GainPos[NB_ANALOGINPUTS];
+
+// Curve on |u| in 0..Q12, strength 0..15
+static int32_t Shape(byte type, int32_t u, int32_t strength) {
+  int32_t shaped;
+  switch (type) {
+    case Config::AInCurves::Expo:
+      // u^3
+      shaped = (((u * u) >> 12) * u) >> 12;
+      break;
+    case Config::AInCurves::SCurve:
+      {
+        // 3u^2 - 2u^3
+        int32_t u2 = (u * u) >> 12;
+        shaped = 3 * u2 - ((2 * u2 * u) >> 12);
+      }
+      break;
+    default:
+      return u;
+  }
+  return u + ((shaped - u) * strength) / 15;
+}
+
+static void SetupInput(uint8_t ain) {
+  auto &ainDB = Config::ConfigFile.AnalogInDB[ain];
+  int32_t dmin = ((int32_t)ainDB.DeadzoneMin) << (AIN_BITS - 8);
+  int32_t dmax = ((int32_t)ainDB.DeadzoneMax) << (AIN_BITS - 8);
+  int32_t satlo = ((int32_t)ainDB.Saturation) << (AIN_BITS - 8);
+  int32_t sathi = AIN_MAX_VAL - satlo;
+  ThresholdNeg[ain] = dmin;
+  ThresholdPos[ain] = dmax;
+  SpanNeg[ain] = (dmin > satlo) ? dmin - satlo : 0;
+  SpanPos[ain] = (sathi > dmax) ? sathi - dmax : 0;
+  GainNeg[ain] = SpanNeg[ain] ? (Q12 << 16) / SpanNeg[ain] : 0;
+  GainPos[ain] = SpanPos[ain] ? (Q12 << 16) / SpanPos[ain] : 0;
+
+  byte type = ainDB.Curve & Config::AInCurves::TypeMask;
+  int32_t strength = (ainDB.Curve & Config::AInCurves::StrengthMask) >> 4;
+  uint16_t custom[CURVE_POINTS];
+  if (type == Config::AInCurves::Custom) {
+    Config::LoadCurve(ain, custom);
+    // Unset table: fall back to linear
+    for (uint8_t k = 0; k < CURVE_POINTS; k++) {
+      if (custom[k] > AIN_MAX_VAL) {
+        type = Config::AInCurves::Linear;
+        break;
+      }
+    }
+  }
+
+  for (uint8_t k = 0; k < CURVE_POINTS; k++) {
+    int32_t u = ((int32_t)k << CURVE_STEP_BITS) - Q12;
+    int32_t y;
+    if (type == Config::AInCurves::Custom) {
+      // Custom points are already evenly spread over u
+      y = custom[k];
+    } else if (u < 0) {
+      y = AIN_CENTERED_VAL - ((Shape(type, -u, strength) * AIN_CENTERED_VAL) >> 12);
+    } else {
+      y = AIN_CENTERED_VAL + ((Shape(type, u, strength) * (AIN_MAX_VAL - AIN_CENTERED_VAL)) >> 12);
+    }
+    LUT[ain][k] = (int16_t)y;
+  }
+}
+
+// Compile lookup tables from the configuration
+void Setup() {
+  for (uint8_t i = 0; i < NB_ANALOGINPUTS; i++) {
+    SetupInput(i);
+  }
+}
+
+// Curve of an input value in AIN_BITS units
+int16_t Apply(uint8_t ain, int16_t value) {
+  // Normalized input shifted to 0..2*Q12
+  uint16_t v;
+  if (value < ThresholdNeg[ain]) {
+    uint16_t d = ThresholdNeg[ain] - value;
+    v = (d >= SpanNeg[ain]) ? 0 : Q12 - (uint16_t)((d * GainNeg[ain]) >> 16);
+  } else if (value > ThresholdPos[ain]) {
+    uint16_t d = value - ThresholdPos[ain];
+    v = (d >= SpanPos[ain]) ? 2 * Q12 : Q12 + (uint16_t)((d * GainPos[ain]) >> 16);
+  } else {
+    v = Q12;
+  }
+  uint8_t idx = v >> CURVE_STEP_BITS;
+  uint8_t frac = (uint8_t)(v >> (CURVE_STEP_BITS - 8));
+  const int16_t *lut = &LUT[ain][idx];
+  if (idx >= CURVE_POINTS - 1)
+    return lut[0];
+  return lut[0] + (int16_t)(((int32_t)(lut[1] - lut[0]) * frac) >> 8);
+}
+
+}
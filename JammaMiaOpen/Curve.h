@@ -0,0 +1,16 @@
+/*
+  Response curves of the analog inputs, compiled into lookup tables
+*/
+#pragma once
+#include "Config.h"
+
+namespace Curve {
+
+// Thresholds of digitalized analog inputs (keys, buttons, HAT), in AIN_BITS units
+extern int16_t ThresholdNeg[NB_ANALOGINPUTS];
+extern int16_t ThresholdPos[NB_ANALOGINPUTS];
+
+void Setup();
+int16_t Apply(uint8_t ain, int16_t value);
+
+}
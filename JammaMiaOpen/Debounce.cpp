@@ -0,0 +1,124 @@
+/*
+  Bit-parallel debouncing of the digital inputs word
+
+  Each input has an 8-bit down counter loaded with its debounce time in ms
+  (DigitalInputConfig.DebounceMs). Counters are stored as vertical counters:
+  bitplane k holds bit k of the 32 counters, so all inputs are decremented,
+  reloaded and tested for zero with a few 32-bit operations.
+
+  Two modes per input:
+  - eager (default): an edge is reported at once, then the input is locked
+    until its counter expires. No added latency.
+  - integrating (DInOptions::DebounceIntegrate): an edge is reported once
+    the input stayed in its new state for the whole debounce time.
+*/
+#include "Debounce.h"
+
+namespace Debounce {
+
+// Number of bits of the counters
+#define COUNTER_BITS (8)
+
+// Vertical counters, bitplane k is bit k of each input counter
+static uint32_t Counters[COUNTER_BITS];
+// Bitplanes of the per-input debounce time
+static uint32_t Reload[COUNTER_BITS];
+// Inputs using integrating mode, others are eager
+static uint32_t IntegrateMask = 0;
+// Inputs whose counter is running
+static uint32_t Running = 0;
+// Debounced state
+static uint32_t State = 0;
+static uint16_t LastUpdate_ms = 0;
+
+// Recompute per-input debounce time and modes from config
+void Setup() {
+  memset(Reload, 0, sizeof(Reload));
+  IntegrateMask = 0;
+  for (uint8_t i = 0; i < NB_DIGITALINPUTS; i++) {
+    uint32_t mask = (uint32_t)1 << i;
+    uint8_t time = Config::ConfigFile.DigitalInB[i].DebounceMs;
+    for (uint8_t k = 0; k < COUNTER_BITS; k++) {
+      if (time & (1 << k)) {
+        Reload[k] |= mask;
+      }
+    }
+    if (Config::ConfigFile.DigitalInB[i].Options & Config::DInOptions::DebounceIntegrate) {
+      IntegrateMask |= mask;
+    }
+  }
+  Running = 0;
+}
+
+static void ReloadCounters(uint32_t mask) {
+  for (uint8_t k = 0; k < COUNTER_BITS; k++) {
+    Counters[k] = (Counters[k] & ~mask) | (Reload[k] & mask);
+  }
+}
+
+// Inputs whose counter is zero
+static uint32_t Zero() {
+  uint32_t nonzero = 0;
+  for (uint8_t k = 0; k < COUNTER_BITS; k++) {
+    nonzero |= Counters[k];
+  }
+  return ~nonzero;
+}
+
+// Decrement by one the counters selected by mask (none of them being zero)
+static void Decrement(uint32_t mask) {
+  uint32_t borrow = mask;
+  for (uint8_t k = 0; (k < COUNTER_BITS) && (borrow != 0); k++) {
+    uint32_t c = Counters[k];
+    Counters[k] = c ^ borrow;
+    borrow &= ~c;
+  }
+}
+
+// raw: inputs word, bit i set when input i is pressed
+// returns debounced inputs word
+uint32_t Update(uint32_t raw) {
+  // Let time run for running counters
+  uint16_t now = (uint16_t)millis();
+  uint16_t elapsed = now - LastUpdate_ms;
+  LastUpdate_ms = now;
+  if (elapsed > 255) {
+    elapsed = 255;
+  }
+  while (elapsed-- > 0) {
+    uint32_t active = Running & ~Zero();
+    if (active == 0)
+      break;
+    Decrement(active);
+  }
+  uint32_t zero = Zero();
+  uint32_t diff = raw ^ State;
+
+  // Eager inputs: a running counter means locked out after last edge
+  Running &= ~(zero & ~IntegrateMask);
+  uint32_t accept = diff & ~IntegrateMask & ~Running;
+
+  // Integrating inputs: counter runs while input differs from debounced state
+  uint32_t idiff = diff & IntegrateMask;
+  // Bounced back: cancel
+  Running &= ~(IntegrateMask & ~idiff);
+  uint32_t start = idiff & ~Running;
+  if (start != 0) {
+    ReloadCounters(start);
+    Running |= start;
+    zero = Zero();
+  }
+  accept |= idiff & Running & zero;
+
+  // Report accepted edges, lock out eager inputs
+  State ^= accept;
+  Running &= ~(accept & IntegrateMask);
+  uint32_t lock = accept & ~IntegrateMask;
+  if (lock != 0) {
+    ReloadCounters(lock);
+    Running |= lock;
+  }
+  return State;
+}
+
+}
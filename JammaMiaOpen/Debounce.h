@@ -0,0 +1,12 @@
+/*
+  Bit-parallel debouncing of the digital inputs word
+*/
+#pragma once
+#include "Config.h"
+
+namespace Debounce {
+
+void Setup();
+uint32_t Update(uint32_t raw);
+
+}
@@ -12,8 +12,8 @@ uint16_t refreshRate_us = 0;
 
 
 
-// All digital inputs
-bool DIn[NB_DIGITALINPUTS] = {};
+// All digital inputs, bit i set when input i is pressed
+uint32_t DIn = 0;
 // All analog inputs
 int16_t AIn[NB_ANALOGINPUTS] = {};
 // All digital outputs
@@ -16,11 +16,12 @@ public:
 
 extern InternalConfig VolatileConfig;
 
+// Duration of last scan of the MCP inputs
 extern uint16_t ioReadTime_us;
 extern uint16_t refreshRate_us;
 
-// All digital inputs
-extern bool DIn[NB_DIGITALINPUTS];
+// All digital inputs, bit i set when input i is pressed
+extern uint32_t DIn;
 // All analog inputs
 extern int16_t AIn[NB_ANALOGINPUTS];
 // All digital outputs
@@ -0,0 +1,140 @@
+/*
+  Lightguns as absolute pointers
+
+  Analog inputs of type Gun give the X/Y position of the gun of a player,
+  from their calibrated values: the host gets the position itself, with
+  no drift, instead of relative moves toward it. Digital inputs of type
+  Gun give its buttons, trigger and reload being the first two. A report
+  is sent when the position or the buttons changed, at most once per USB
+  frame (1ms).
+
+  A gun is off-screen when one of its axes is within the margin of an end
+  of travel. The pointer then stays at its last position on screen, and
+  the trigger pulled off-screen reports reload instead, until released.
+  In corner mode the off-screen pointer goes to the top left corner with
+  the trigger reported as is, for games reloading on shots out of screen.
+*/
+#include "Gun.h"
+#ifdef USE_GUN
+
+#include <AbsMouseN.h>
+
+//#define DEBUG_PRINTF
+
+#define GUN_TRIGGER MOUSE_LEFT
+#define GUN_RELOAD MOUSE_RIGHT
+
+namespace Gun {
+
+static AbsMouseN_ *pGun = nullptr;
+static bool StateHasChanged = false;
+// Last position X/Y of each player, in AIN_BITS units
+static uint16_t Position[2][2];
+// Buttons held by inputs, before the off-screen rule
+static uint8_t Buttons[2];
+// Trigger pulled off-screen, reported as reload until released
+static uint8_t Reloading = 0;
+// USB frame of last report
+static uint8_t LastFrame = 0;
+
+const uint8_t GunButtons[] = { MOUSE_LEFT, MOUSE_RIGHT, MOUSE_MIDDLE, MOUSE_PREV, MOUSE_NEXT, 0, 0, 0 };
+
+// Scale a position to the pointer range, top bits repeated to reach its end
+static uint16_t Scale(uint16_t value) {
+  return (value << (15 - AIN_BITS)) | (value >> (2 * AIN_BITS - 15));
+}
+
+void Setup() {
+  pGun = new AbsMouseN_(true);
+  pGun->begin();
+  // Centered until the gun is seen on screen
+  for (uint8_t p = 0; p < 2; p++) {
+    Position[p][0] = AIN_CENTERED_VAL;
+    Position[p][1] = AIN_CENTERED_VAL;
+    pGun->moveTo(Scale(AIN_CENTERED_VAL), Scale(AIN_CENTERED_VAL), p == 1);
+  }
+}
+
+// Button mask of a button index
+uint8_t ButtonMask(byte button) {
+  return GunButtons[button & 0b111];  // up to 5 buttons
+}
+
+static bool IsOffscreen(uint8_t p) {
+  uint16_t margin = (uint16_t)(Config::ConfigFile.GunOffscreen & Config::GunOffscreenOptions::GunMarginMask) << 4;
+  if (margin == 0)
+    return false;
+  for (uint8_t i = 0; i < 2; i++) {
+    if ((Position[p][i] < margin) || (Position[p][i] > (AIN_MAX_VAL - margin)))
+      return true;
+  }
+  return false;
+}
+
+// Press/release buttons (mask) of a player
+void Button(uint8_t player, uint8_t mask, bool pressed) {
+  uint8_t bit = 1 << player;
+  if (mask & GUN_TRIGGER) {
+    if (!pressed) {
+      Reloading &= ~bit;
+    } else if (!(Config::ConfigFile.GunOffscreen & Config::GunOffscreenOptions::GunCorner) && IsOffscreen(player)) {
+      Reloading |= bit;
+    }
+  }
+  if (pressed) {
+    Buttons[player] |= mask;
+  } else {
+    Buttons[player] &= ~mask;
+  }
+  StateHasChanged = true;
+#ifdef DEBUG_PRINTF
+  Serial.print(F("Mgun P"));
+  Serial.print(player + 1);
+  Serial.print(pressed ? F(" press btn ") : F(" release btn "));
+  Serial.println(mask, HEX);
+#endif
+}
+
+// Position of an axis: player in bit 7, inverted in bit 3, X/Y in bits 1..0
+void SetAxis(byte axis, int16_t value) {
+  if ((axis & 0b11) == 0)
+    return;
+  uint8_t p = axis >> 7;
+  uint8_t idx = (axis & 0b01) ? 0 : 1;
+  if (axis & 0b1000) {
+    value = AIN_MAX_VAL - value;
+  }
+  if (Position[p][idx] != (uint16_t)value) {
+    Position[p][idx] = value;
+    StateHasChanged = true;
+  }
+}
+
+void UpdateToPC() {
+  if ((pGun == nullptr) || !StateHasChanged)
+    return;
+  // Once per USB frame
+  uint8_t frame = UDFNUML;
+  if (frame == LastFrame)
+    return;
+  LastFrame = frame;
+  StateHasChanged = false;
+  bool corner = Config::ConfigFile.GunOffscreen & Config::GunOffscreenOptions::GunCorner;
+  for (uint8_t p = 0; p < 2; p++) {
+    if (!IsOffscreen(p)) {
+      pGun->moveTo(Scale(Position[p][0]), Scale(Position[p][1]), p == 1);
+    } else if (corner) {
+      pGun->moveTo(0, 0, p == 1);
+    }
+    uint8_t buttons = Buttons[p];
+    if (Reloading & (1 << p)) {
+      buttons = (buttons & ~GUN_TRIGGER) | GUN_RELOAD;
+    }
+    pGun->release(~buttons, p == 1);
+    pGun->press(buttons, p == 1);
+    pGun->sendReport(p == 1);
+  }
+}
+
+}
+#endif
@@ -0,0 +1,14 @@
+#pragma once
+#include "Config.h"
+
+#ifdef USE_GUN
+
+namespace Gun {
+void Setup();
+uint8_t ButtonMask(byte button);
+void Button(uint8_t player, uint8_t mask, bool pressed);
+void SetAxis(byte axis, int16_t value);
+void UpdateToPC();
+}
+
+#endif
@@ -5,7 +5,24 @@
 #include "Config.h"
 #include "Globals.h"
 #include "Protocol.h"
+#include "Mcp.h"
+#include "Debounce.h"
+#include "Socd.h"
+#include "Chord.h"
+#include "Adc.h"
+#include "Calib.h"
+#include "Curve.h"
+#include "Stick.h"
+#include "Mapping.h"
+#include "Tick.h"
+#include "Turbo.h"
+#include "Macro.h"
+#include "Ramp.h"
+#include "Rotary.h"
+#include "Quadrature.h"
+#ifndef USE_MCP_TWI_DRIVER
 #include <Adafruit_MCP23X17.h>
+#endif
 #include <digitalWriteFast.h>
 
 #ifdef USE_KEYB
@@ -17,6 +34,9 @@
 #ifdef USE_MOUSE
 #include "Mou.h"
 #endif
+#ifdef USE_GUN
+#include "Gun.h"
+#endif
 
 //#define DEBUG_PRINTF
 
@@ -30,8 +50,13 @@ const int MCUDigitalInpin[4] = { 8, 16, 14, 15 };
 const int MCUAnalogInpin[NB_ANALOGINPUTS] = { 18, 19, 20, 21 };
 const int MCUAnalogOutpin[NB_ANALOGOUTPUTS] = { 5, 6, 9, 10 };
 
+// MCP outputs pins (GPA7 and GPB7)
+#define MCP_OUTPUTS_MASK ((uint16_t)((1 << 7) | (1 << 15)))
+
+#ifndef USE_MCP_TWI_DRIVER
 Adafruit_MCP23X17 mcp1;  //declaration for chip 1
 Adafruit_MCP23X17 mcp2;  //declaration for chip 2
+#endif
 
 uint32_t tickCounter = 0;
 
@@ -47,10 +72,17 @@ void setup() {
 
   //--- CONFIG ---
 
+  bool test2 = !digitalReadFast(MCUDigitalInpin[2]);
+  bool tilt = !digitalReadFast(MCUDigitalInpin[3]);
+  // Read configuration, if that fails then reset configuration
+  epromResetDone = (Config::LoadConfigFromEEPROM() != 1);
+  // Encoder 1 on TEST2/TILT pins: their level at rest is not a boot command
+  if (!epromResetDone && (Quadrature::UsedDInMask() & 0b1100)) {
+    test2 = false;
+    tilt = false;
+  }
   // Maintain TEST2 + TILT to force reset of configuration
-  epromResetDone = (!digitalReadFast(MCUDigitalInpin[2])) && (!digitalReadFast(MCUDigitalInpin[3]));
-  // Read configuration, if that fails then reset configuration again
-  epromResetDone |= (Config::LoadConfigFromEEPROM() != 1);
+  epromResetDone |= test2 && tilt;
 
   if (epromResetDone) {
     Config::ResetConfig();
@@ -58,25 +90,44 @@ void setup() {
   }
 
   // Maintain TEST2 only to force no emulation at boot
-  bool stopEmulation = (!digitalReadFast(MCUDigitalInpin[2])) && (digitalReadFast(MCUDigitalInpin[3]));
+  bool stopEmulation = test2 && !tilt;
   if (stopEmulation) {
     Globals::VolatileConfig.DoEmulation = false;
   }
 
+  //--- ADC sequencer ---
+  Adc::Setup(MCUAnalogInpin);
+
+  //--- Hardware tick ---
+  Tick::Setup();
+
   //--- Start USB stack ---
   Protocol::SetupPort();
 
   // I2C
-  if (!mcp1.begin_I2C(0x20, &Wire) || !mcp2.begin_I2C(0x21, &Wire)) {
+#ifdef USE_MCP_TWI_DRIVER
+  // Maximum I2C speed for Atmega32u4
+  Mcp::Setup(800000L);
+#ifdef USE_MCP_INTERRUPT
+  bool mcpInterrupts = true;
+#else
+  bool mcpInterrupts = false;
+#endif
+  if (!Mcp::ConfigureChip(MCP1_ADDR, MCP_OUTPUTS_MASK, mcpInterrupts) || !Mcp::ConfigureChip(MCP2_ADDR, MCP_OUTPUTS_MASK, mcpInterrupts)) {
+    Serial.println(F("I2C Error"));
+  }
+#else
+  if (!mcp1.begin_I2C(MCP1_ADDR, &Wire) || !mcp2.begin_I2C(MCP2_ADDR, &Wire)) {
     Serial.println(F("I2C Error"));
   }
 
   // Set to maximum I2C speed for Atmega32u4
   Wire.setClock(800000L);
-  /*mcp1.setupInterrupts(true, false, LOW);
-  mcp1.setupInterruptPin(0, LOW);
-  mcp2.setupInterrupts(true, false, LOW);
-  mcp2.setupInterruptPin(0, LOW);*/
+#ifdef USE_MCP_INTERRUPT
+  // Mirrored INTA/INTB, open-drain and active low: both chips share the INT line
+  mcp1.setupInterrupts(true, true, LOW);
+  mcp2.setupInterrupts(true, true, LOW);
+#endif
 
   for (int8_t i = 0; i <= 15; i++) {
     if (i == 7 || i == 15) {
@@ -87,8 +138,14 @@ void setup() {
     } else {
       mcp1.pinMode(i, INPUT_PULLUP);
       mcp2.pinMode(i, INPUT_PULLUP);
+#ifdef USE_MCP_INTERRUPT
+      // Interrupt on any change of the input
+      mcp1.setupInterruptPin(i, CHANGE);
+      mcp2.setupInterruptPin(i, CHANGE);
+#endif
     }
   }
+#endif
 
   // Setup emulation
   switch (Config::ConfigFile.EmulationMode) {
@@ -119,6 +176,17 @@ void setup() {
       Mou::Setup();
       break;
 #endif
+#ifdef USE_GUN
+    case Config::EmulationModes::Lightgun:
+      Gun::Setup();
+      break;
+#endif
+#if defined(USE_KEYB) && defined(USE_GUN)
+    case Config::EmulationModes::LightgunAndKeyboard:
+      Keyb::Setup();
+      Gun::Setup();
+      break;
+#endif
 
     default:
     case Config::EmulationModes::NoEmulation:
@@ -144,17 +212,21 @@ void setup() {
 void MCPISR();
 
 void SetupInterrupt() {
-  // Enable HSync interrupt to start measuring HSync pulses for next 500ms
+#ifdef USE_MCP_INTERRUPT
+  // MCP INT line is open-drain active low: a change pulls it down
+  attachInterrupt(digitalPinToInterrupt(Interruptpin), MCPISR, FALLING);
+#else
   attachInterrupt(digitalPinToInterrupt(Interruptpin), MCPISR, RISING);
+#endif
 }
 
 void StopInterrupt() {
-  // Disable HSync interrupt for the next 500ms
   detachInterrupt(digitalPinToInterrupt(Interruptpin));
 }
 
 // Flag to tell main loop to refresh MCP (an input triggered it)
-bool doRefresh = false;
+// Starts set so that the first loop always read the inputs
+volatile bool doRefresh = true;
 void MCPISR() {
   doRefresh = true;
   // Clear any new pending interrupt on this pin to avoid locking the arduino when
@@ -162,10 +234,141 @@ void MCPISR() {
   EIFR |= (1 << INTF6);
 }
 
+// Force a full read/write of the MCPs (safety refresh), cleared once done
+bool mcpForceRefresh = true;
+uint32_t lastMCPRefresh_us = 0;
+// Last value written to the MCPs outputs latches
+uint16_t lastMCPOLAT[2] = {};
+
+#ifdef USE_MCP_CAPTURE
+// A captured pulse was reported, live levels are to be reported on next refresh
+bool mcpPulsePending = false;
+uint16_t mcpLiveIOs[2] = {};
+
+// Sequential read of INTFA/B, INTCAPA/B and GPIOA/B in one transaction.
+// Reading INTCAP/GPIO clears the interrupt.
+bool ReadMCPCapture(uint8_t addr, uint16_t &intf, uint16_t &intcap, uint16_t &gpio) {
+#ifdef USE_MCP_TWI_DRIVER
+  uint8_t regs[6];
+  if (!Mcp::ReadRegs(addr, MCP_REG_INTFA, regs, sizeof(regs))) {
+    return false;
+  }
+  intf = regs[0] | ((uint16_t)regs[1] << 8);
+  intcap = regs[2] | ((uint16_t)regs[3] << 8);
+  gpio = regs[4] | ((uint16_t)regs[5] << 8);
+  return true;
+#else
+  Wire.beginTransmission(addr);
+  Wire.write(MCP_REG_INTFA);
+  if (Wire.endTransmission(false) != 0) {
+    return false;
+  }
+  if (Wire.requestFrom(addr, (uint8_t)6) != 6) {
+    return false;
+  }
+  intf = Wire.read();
+  intf |= (uint16_t)Wire.read() << 8;
+  intcap = Wire.read();
+  intcap |= (uint16_t)Wire.read() << 8;
+  gpio = Wire.read();
+  gpio |= (uint16_t)Wire.read() << 8;
+  return true;
+#endif
+}
+
+// Merge live and captured levels of one MCP. Inputs that raised an interrupt
+// and are back to their last reported level were shorter than the loop period:
+// report the captured level now and the live level on next refresh.
+void MergeMCPCapture(int mcp, uint16_t intf, uint16_t intcap, uint16_t gpio) {
+  // Inputs are inversed (logic 0 means connected to GND = pressed)
+  uint16_t live = ~gpio;
+  uint16_t captured = ~intcap;
+  uint16_t reported = Globals::MCPIOs[mcp];
+  uint16_t lost = intf & (captured ^ reported) & ~(live ^ reported) & ~MCP_OUTPUTS_MASK;
+  Globals::MCPIOs[mcp] = live ^ lost;
+  mcpLiveIOs[mcp] = live;
+  if (lost) {
+    mcpPulsePending = true;
+  }
+}
+#endif
+
 void RefreshMCPInputs() {
+#ifdef USE_MCP_CAPTURE
+  if (mcpPulsePending) {
+    // Captured pulses were reported during last loop, now report live levels.
+    // A new change keeps the INT line asserted and will be read next loop.
+    Globals::MCPIOs[0] = mcpLiveIOs[0];
+    Globals::MCPIOs[1] = mcpLiveIOs[1];
+    mcpPulsePending = false;
+    return;
+  }
+#endif
+#ifdef USE_MCP_ASYNC_SCAN
+  // Publish the snapshot of the last completed scan, next scan is started
+  // with the outputs in RefreshMCPOutputs()
+  Mcp::ChipSnapshot snap[2];
+  if (!Mcp::GetSnapshot(snap)) {
+    return;
+  }
+  for (int i = 0; i < 2; i++) {
+#ifdef USE_MCP_CAPTURE
+    MergeMCPCapture(i, snap[i].IntFlags, snap[i].IntCapture, snap[i].GPIO);
+#else
+    // Inputs are inversed (logic 0 means connected to GND = pressed)
+    Globals::MCPIOs[i] = ~snap[i].GPIO;
+#endif
+  }
+  // Cost of one scan of the expanders (running in background)
+  Globals::ioReadTime_us = Mcp::ScanTime_us();
+#else
+#ifdef USE_MCP_INTERRUPT
+  // Only touch the I2C bus when an input changed: INT line asserted (low)
+  // or interrupt seen since last read. Otherwise keep previous values.
+  if (!doRefresh && digitalReadFast(Interruptpin) && !mcpForceRefresh) {
+    return;
+  }
+  // Clear flag before reading, reading GPIO will release the INT line
+  doRefresh = false;
+#endif
+  uint32_t start = micros();
+#ifdef USE_MCP_CAPTURE
+  uint16_t intf, intcap, gpio;
+  if (ReadMCPCapture(MCP1_ADDR, intf, intcap, gpio)) {
+    MergeMCPCapture(0, intf, intcap, gpio);
+  }
+  if (ReadMCPCapture(MCP2_ADDR, intf, intcap, gpio)) {
+    MergeMCPCapture(1, intf, intcap, gpio);
+  }
+#elif defined(USE_MCP_TWI_DRIVER)
+  uint16_t gpio;
+  // Inputs are inversed (logic 0 means connected to GND = pressed)
+  if (Mcp::Read16(MCP1_ADDR, MCP_REG_GPIOA, gpio)) {
+    Globals::MCPIOs[0] = ~gpio;
+  }
+  if (Mcp::Read16(MCP2_ADDR, MCP_REG_GPIOA, gpio)) {
+    Globals::MCPIOs[1] = ~gpio;
+  }
+#else
   // Inputs are inversed (logic 0 means connected to GND = pressed)
   Globals::MCPIOs[0] = ~(mcp1.readGPIOAB());
   Globals::MCPIOs[1] = ~(mcp2.readGPIOAB());
+#endif
+  // Cost of one scan of the expanders
+  Globals::ioReadTime_us = micros() - start;
+#endif
+}
+
+void WriteMCPGPIO(int mcp, uint16_t gpio) {
+#ifdef USE_MCP_TWI_DRIVER
+  Mcp::Write16(mcp == 0 ? MCP1_ADDR : MCP2_ADDR, MCP_REG_OLATA, gpio);
+#else
+  if (mcp == 0) {
+    mcp1.writeGPIOAB(gpio);
+  } else {
+    mcp2.writeGPIOAB(gpio);
+  }
+#endif
 }
 
 void RefreshMCPOutputs(bool doutstates[4]) {
@@ -176,30 +379,70 @@ void RefreshMCPOutputs(bool doutstates[4]) {
   bitWrite(Globals::MCPIOs[1], 15, !doutstates[3]);
   uint16_t gpio1 = ~(Globals::MCPIOs[0]);
   uint16_t gpio2 = ~(Globals::MCPIOs[1]);
+#ifdef USE_MCP_ASYNC_SCAN
+  // Last scan dropped: its outputs were not written, write and read all again
+  if (Mcp::ScanFailed()) {
+    mcpForceRefresh = true;
+#ifdef USE_MCP_INTERRUPT
+    doRefresh = true;
+#endif
+  }
+  uint16_t olat[2] = { gpio1, gpio2 };
+  // Only write when an output has changed (or on safety refresh)
+  uint8_t writeMask = 0;
+  for (int i = 0; i < 2; i++) {
+    if (mcpForceRefresh || ((olat[i] ^ lastMCPOLAT[i]) & MCP_OUTPUTS_MASK)) {
+      writeMask |= 1 << i;
+    }
+  }
+#ifdef USE_MCP_INTERRUPT
+  // Scan only when an input changed or an output must be written
+  bool doScan = doRefresh || !digitalReadFast(Interruptpin) || mcpForceRefresh || writeMask;
+#else
+  bool doScan = true;
+#endif
+  // The scan runs in background while inputs are processed.
+  // If a scan is still running, it will be started in a next loop.
+  if (doScan && Mcp::StartScan(olat, writeMask)) {
+#ifdef USE_MCP_INTERRUPT
+    doRefresh = false;
+#endif
+    if (writeMask & 1) {
+      lastMCPOLAT[0] = gpio1;
+    }
+    if (writeMask & 2) {
+      lastMCPOLAT[1] = gpio2;
+    }
+    mcpForceRefresh = false;
+  }
+#elif defined(USE_MCP_INTERRUPT)
+  // Only write when an output has changed (or on safety refresh)
+  if (mcpForceRefresh || ((gpio1 ^ lastMCPOLAT[0]) & MCP_OUTPUTS_MASK)) {
+    WriteMCPGPIO(0, gpio1);
+    lastMCPOLAT[0] = gpio1;
+  }
+  if (mcpForceRefresh || ((gpio2 ^ lastMCPOLAT[1]) & MCP_OUTPUTS_MASK)) {
+    WriteMCPGPIO(1, gpio2);
+    lastMCPOLAT[1] = gpio2;
+  }
+  mcpForceRefresh = false;
+#else
   // Since refresh outputs over I2C is slow, alternate
   if (tickCounter % 2 == 0) {
-    mcp1.writeGPIOAB(gpio1);
+    WriteMCPGPIO(0, gpio1);
   } else {
-    mcp2.writeGPIOAB(gpio2);
+    WriteMCPGPIO(1, gpio2);
   }
+#endif
 }
 
 
-uint16_t lastmcuio = 0;
-volatile bool lastDInState[NB_DIGITALINPUTS] = {};
-volatile bool DInWasShifted[NB_DIGITALINPUTS] = {};
-bool isShifted = false;
-
 void ConfigureMCUPins() {
   // Configure I2C pins on MCU
   pinMode(Interruptpin, INPUT_PULLUP);
   pinMode(SDApin, INPUT_PULLUP);
   pinMode(SCLpin, INPUT_PULLUP);
 
-  // ADC Prescaler of 16
-  ADCSRA &= ~((1 << ADPS0) + (1 << ADPS1));
-  ADCSRA |= 1 << ADPS2;
-
   for (int i = 0; i < (int)(sizeof(MCUDigitalInpin) / sizeof(MCUDigitalInpin[0])); i++) {
     pinMode(MCUDigitalInpin[i], INPUT_PULLUP);
   }
@@ -230,38 +473,29 @@ void ReadDIn() {
   // Update internal inputs
   RefreshMCUInputs();
 
-  // remap from mcp din numbering to internal IO numbering 0..27
-  for (int i = 0; i < 7; i++) {
-    // MCP1 bits i=0..6 and j=8..14 to 0..13 (14 bits)
-    volatile int j = i + 8;
-    Globals::DIn[i] = bitRead(Globals::MCPIOs[0], i);      // MCP1:GPA 0..6, =1 when pressed, =0 when released
-    Globals::DIn[j - 1] = bitRead(Globals::MCPIOs[0], j);  // MCP1:GPB 8..14
-
-    Globals::DIn[i + 14] = bitRead(Globals::MCPIOs[1], i);      // MCP2:GPA 0..6
-    Globals::DIn[j - 1 + 14] = bitRead(Globals::MCPIOs[1], j);  // MCP2:GPB 8..14
-  }
-
-  // remap from mcu din numbering to internal IO numbering 28..31
-  for (int i = 0; i < 4; i++) {
-    // MCU din 8, 16, 14, 15
-    Globals::DIn[i + 28] = bitRead(Globals::MCUIOs, i);  // =1 when pressed, =0 when released
-  }
-
-  // Do we have a "shift input" configured?
-  if (Config::ConfigFile.ShiftInput > 0) {
-    // Check the input state
-    if (Globals::DIn[Config::ConfigFile.ShiftInput - 1]) {
-      // Save "shifted" state
-      isShifted = true;
-    } else {
-      isShifted = false;
-    }
-  }
+  // remap from mcp din numbering to internal IO numbering 0..27, =1 when pressed, =0 when released
+  // MCP1:GPA 0..6 to 0..6, MCP1:GPB 8..14 to 7..13
+  uint16_t mcp = Globals::MCPIOs[0];
+  uint32_t din = (mcp & 0x7F) | ((mcp >> 1) & 0x3F80);
+  // MCP2:GPA 0..6 to 14..20, MCP2:GPB 8..14 to 21..27
+  mcp = Globals::MCPIOs[1];
+  din |= (uint32_t)((mcp & 0x7F) | ((mcp >> 1) & 0x3F80)) << 14;
+  // remap from mcu din numbering to internal IO numbering 28..31 (MCU din 8, 16, 14, 15)
+  din |= (uint32_t)(Globals::MCUIOs & 0x0F) << 28;
+  // Apply inverted and disabled inputs options, then debounce,
+  // rotary decoding, SOCD cleaning, chords and autofire
+  din = Rotary::Apply(Debounce::Update((din ^ Config::DInInvertMask) & Config::DInEnableMask));
+  din = Socd::Resolve(din);
+  Globals::DIn = Turbo::Apply(Chord::Apply(din));
 }
 
 void ReadAIn() {
-  for (int i = 0; i < NB_ANALOGINPUTS; i++) {
-    Globals::AIn[i] = analogRead(MCUAnalogInpin[i]);
+  // Latest values converted in background, if any
+  static int16_t raw[NB_ANALOGINPUTS];
+  if (!Adc::Fetch(raw))
+    return;
+  for (uint8_t i = 0; i < NB_ANALOGINPUTS; i++) {
+    Globals::AIn[i] = Calib::Apply(i, raw[i]);
   }
 }
 
@@ -271,225 +505,160 @@ void WriteDOut() {
 }
 
 void WriteAOut() {
-  // Write mcu pwm output
+  // Write mcu pwm output, but on pins used by an encoder
   for (int i = 0; i < NB_ANALOGOUTPUTS; i++) {
-    analogWrite(MCUAnalogOutpin[i], Globals::AOut[i]);
+    if (!Quadrature::UsedAOut(i)) {
+      analogWrite(MCUAnalogOutpin[i], Globals::AOut[i]);
+    }
   }
 }
 
 void ProcessDigitalInput(int index, bool newstate) {
-  auto dinDB = Config::ConfigFile.DigitalInB[index];
-  byte mapping = dinDB.MapTo;
-  if (newstate) {
-    // pressed
-    if (isShifted && (dinDB.MapToShifted > 0)) {
-      DInWasShifted[index] = true;
-      mapping = dinDB.MapToShifted;
-    } else {
-      DInWasShifted[index] = false;
-    }
-  } else {
-    // released
-    if (DInWasShifted[index]) {
-      mapping = dinDB.MapToShifted;
-    }
-  }
-
 #ifdef DEBUG_PRINTF
   Serial.print(F("Mdin "));
   Serial.print(index);
   Serial.print(F(" type 0x"));
-  Serial.print(dinDB.Type, HEX);
+  Serial.print(Config::ConfigFile.DigitalInB[index].Type, HEX);
   Serial.print(F(" state "));
-  Serial.print(newstate);
-  Serial.print(F(" mapto 0x"));
-  Serial.println(mapping, HEX);
+  Serial.println(newstate);
 #endif
+  // Target from compiled mapping tables
+  Mapping::DigitalInput(index, newstate);
+}
 
-  switch (dinDB.Type) {
-#ifdef USE_KEYB
-    case Config::MappingType::Key:
-      {
-        if (newstate) {
-          Keyb::Press(mapping);
-        } else {
-          Keyb::Release(mapping);
-        }
-      }
-      break;
-#endif
-#ifdef USE_JOY
-    case Config::MappingType::JoyButton:
-      {
-        if (newstate) {
-          Joy::BtnPress(mapping);
-        } else {
-          Joy::BtnRelease(mapping);
-        }
-      }
-      break;
-    case Config::MappingType::JoyDirHAT:
-      {
-        if (newstate) {
-          Joy::SetHATSwitch(mapping, true);
-        } else {
-          Joy::SetHATSwitch(mapping, false);
-        }
-      }
-      break;
-#endif
-#ifdef USE_MOUSE
-    case Config::MappingType::MouseButton:
-      {
-        if (newstate) {
-          Mou::BtnPress(mapping);
-        } else {
-          Mou::BtnRelease(mapping);
-        }
-      }
-      break;
-    case Config::MappingType::MouseAxis:
-      {
-        if (newstate) {
-          Mou::MoveAxis(mapping, 2);
-        }
-      }
-      break;
-#endif
 
-    default:
-      break;
+// Only walk the bits that have changed, byte per byte
+void ProcessDigitalInputs(uint32_t changed, uint32_t din) {
+  for (uint8_t i = 0; changed != 0; i += 8, changed >>= 8, din >>= 8) {
+    uint8_t bits = (uint8_t)changed;
+    uint8_t states = (uint8_t)din;
+    for (uint8_t j = i; bits != 0; j++, bits >>= 1, states >>= 1) {
+      if (bits & 1) {
+        ProcessDigitalInput(j, states & 1);
+      }
+    }
   }
 }
 
+// Last reported value of analog axes
+int16_t lastAInValue[NB_ANALOGINPUTS];
+// Digitalize an analog value with a Schmitt trigger around dead zone limits:
+// a limit is moved away from the current zone by the hysteresis
+int8_t AnalogZone(int index, int16_t value, int16_t min, int16_t max) {
+  int8_t zone = Mapping::AInZone[index];
+  int16_t hyst = Config::ConfigFile.AnalogInDB[index].Hysteresis;
+  int16_t lo = min + ((zone < 0) ? hyst : -hyst);
+  int16_t hi = max + ((zone > 0) ? -hyst : hyst);
+  if (value < lo) {
+    return -1;
+  } else if (value > hi) {
+    return 1;
+  }
+  return 0;
+}
 
 // index in 0..3
-// value is between 0 and 1023 (0x3FF). middle point being 511 (0x1FF)
-// Threasholds for center and middle deadzone : 0x100 and 0x300
+// value is between 0 and AIN_MAX_VAL (0xFFF). middle point being AIN_CENTERED_VAL (0x7FF)
+// Threasholds for center and middle deadzone : 0x600 and 0xA00
 void ProcessAnalogInput(int index, int value) {
-  if ((tickCounter % 10) != 0) {
-    // Only update every 10 cycles
-    return;
-  }
-  auto ainDB = Config::ConfigFile.AnalogInDB[index];
-  int16_t min = ((int16_t)ainDB.DeadzoneMin) << 2;
-  int16_t max = ((int16_t)ainDB.DeadzoneMax) << 2;
+  const auto &ainDB = Config::ConfigFile.AnalogInDB[index];
+  int16_t min = Curve::ThresholdNeg[index];
+  int16_t max = Curve::ThresholdPos[index];
 
   switch (ainDB.Type) {
-#ifdef USE_KEYB
-    case Config::MappingType::Key:
-      {
-        // Do thing when input is configured for keyboard
-        if (value < min) {
-          Keyb::Press(ainDB.MapToNeg);
-        } else {
-          Keyb::Release(ainDB.MapToNeg);
-        }
-        if (value > max) {
-          Keyb::Press(ainDB.MapToPos);
-        } else {
-          Keyb::Release(ainDB.MapToPos);
-        }
-      }
-      break;
-#endif
 #ifdef USE_JOY
     case Config::MappingType::JoyAxis:
       {
-        // Only positive mapping is used for analog axes
-        Joy::SetAxis(ainDB.MapToPos, value);
-      }
-      break;
-    case Config::MappingType::JoyButton:
-      {
-        if (value < min) {
-          Joy::BtnPress(ainDB.MapToNeg);
-          Joy::BtnRelease(ainDB.MapToPos);
-        } else if (value > max) {
-          Joy::BtnRelease(ainDB.MapToNeg);
-          Joy::BtnPress(ainDB.MapToPos);
-        } else {
-          Joy::BtnRelease(ainDB.MapToNeg);
-          Joy::BtnRelease(ainDB.MapToPos);
+        // Dead zone, saturation and response curve
+        value = Curve::Apply(index, value);
+        // Only report when the value moved enough, or reached an end of travel
+        int16_t delta = value - lastAInValue[index];
+        if (delta < 0) {
+          delta = -delta;
         }
-      }
-      break;
-    case Config::MappingType::JoyDirHAT:
-      {
-        if (value < min) {
-          Joy::SetHATSwitch(ainDB.MapToNeg, true);
-          Joy::SetHATSwitch(ainDB.MapToPos, false);
-        } else if (value > max) {
-          Joy::SetHATSwitch(ainDB.MapToNeg, false);
-          Joy::SetHATSwitch(ainDB.MapToPos, true);
-        } else {
-          Joy::SetHATSwitch(ainDB.MapToNeg, false);
-          Joy::SetHATSwitch(ainDB.MapToPos, false);
+        if ((delta > ainDB.Threshold) || ((delta != 0) && ((value == 0) || (value == AIN_MAX_VAL)))) {
+          lastAInValue[index] = value;
+          // Only positive mapping is used for analog axes
+          Joy::SetAxis(ainDB.MapToPos, value);
         }
       }
-      break;
+      return;
 #endif
 #ifdef USE_MOUSE
     case Config::MappingType::MouseAxis:
       {
+        // Velocity from the deflection out of the dead zone, other side stopped
         if (value < min) {
-          // Map to -127/127
-          auto amplitude = min - value;
-          int16_t incr = map(amplitude, 0, 1023, -127, 0);
-          Mou::MoveAxis(ainDB.MapToNeg, incr);
-        } else if (value > max) {
-          // Map to -127/127
-          auto amplitude = value - max;
-          int16_t incr = map(amplitude, 0, 1023, 0, 127);
-          Mou::MoveAxis(ainDB.MapToPos, incr);
-        }
-      }
-      break;
-    case Config::MappingType::MouseButton:
-      {
-        if (value < min) {
-          Mou::BtnPress(ainDB.MapToNeg);
-          Mou::BtnRelease(ainDB.MapToPos);
+          Mou::Deflect(ainDB.MapToPos, 0);
+          Mou::Deflect(ainDB.MapToNeg, ((uint32_t)(min - value) * AIN_CENTERED_VAL) / min);
         } else if (value > max) {
-          Mou::BtnRelease(ainDB.MapToNeg);
-          Mou::BtnPress(ainDB.MapToPos);
+          Mou::Deflect(ainDB.MapToNeg, 0);
+          Mou::Deflect(ainDB.MapToPos, ((uint32_t)(value - max) * AIN_CENTERED_VAL) / (AIN_MAX_VAL - max));
         } else {
-          Mou::BtnRelease(ainDB.MapToNeg);
-          Mou::BtnRelease(ainDB.MapToPos);
+          Mou::Deflect(ainDB.MapToPos, 0);
+          Mou::Deflect(ainDB.MapToNeg, 0);
         }
       }
-      break;
+      return;
+#endif
+#ifdef USE_GUN
+    case Config::MappingType::Gun:
+      // Absolute position, only positive mapping is used
+      Gun::SetAxis(ainDB.MapToPos, value);
+      return;
 #endif
-
     default:
       break;
   }
+
+  // Digitalized modes
+  Mapping::AnalogZone(index, AnalogZone(index, value, min, max));
 }
 
 
 
 void RefreshIOs() {
+#if defined(USE_MCP_INTERRUPT) || defined(USE_MCP_ASYNC_SCAN)
   uint32_t start = micros();
+  // Slow safety re-read/re-write of the MCPs in case an interrupt was lost
+  if ((uint32_t)(start - lastMCPRefresh_us) > MCP_SAFETY_REFRESH_US) {
+    mcpForceRefresh = true;
+    lastMCPRefresh_us = start;
+  }
+#endif
   // Refresh to Globals::
   ReadDIn();
   ReadAIn();
   WriteDOut();
   WriteAOut();
-  uint32_t end = micros();
-  Globals::ioReadTime_us = end - start;
-
-  // Digital inputs
-  for (int i = 0; i < NB_DIGITALINPUTS; i++) {
-    // State has changed?
-    if (lastDInState[i] ^ Globals::DIn[i]) {
-      ProcessDigitalInput(i, Globals::DIn[i]);
-      lastDInState[i] = Globals::DIn[i];
-    }
-  }
+
+  // Digital inputs: layer keys first, so that inputs pressed in the same loop use the new layer
+  uint32_t changed = Globals::DIn ^ Mapping::DInHeld;
+  ProcessDigitalInputs(changed & Mapping::LayerInputs, Globals::DIn);
+  ProcessDigitalInputs(changed & ~Mapping::LayerInputs, Globals::DIn);
   // Analog inputs
   for (int i = 0; i < NB_ANALOGINPUTS; i++) {
+    if (Stick::IsPaired(i)) {
+      // X and Y processed together
+      int8_t zones[2];
+      Stick::Update(i >> 1, Globals::AIn[i], Globals::AIn[i + 1], zones);
+      for (uint8_t k = 0; k < 2; k++) {
+        // Axes are reported as usual, the gate only drives digitalized inputs
+        if (Mapping::IsAxis(Config::ConfigFile.AnalogInDB[i + k].Type)) {
+          ProcessAnalogInput(i + k, Globals::AIn[i + k]);
+        } else {
+          Mapping::AnalogZone(i + k, zones[k]);
+        }
+      }
+      i++;
+      continue;
+    }
     ProcessAnalogInput(i, Globals::AIn[i]);
   }
+  // Due steps of playing macros, then ramped axes and rotary sticks
+  Macro::Run();
+  Ramp::Run();
+  Rotary::Run();
 }
 
 void doEmulation() {
@@ -522,6 +691,17 @@ void doEmulation() {
 #if defined(USE_KEYB) && defined(USE_MOUSE)
       Keyb::UpdateToPC();
       Mou::UpdateToPC();
+#endif
+      break;
+    case Config::EmulationModes::Lightgun:
+#ifdef USE_GUN
+      Gun::UpdateToPC();
+#endif
+      break;
+    case Config::EmulationModes::LightgunAndKeyboard:
+#if defined(USE_KEYB) && defined(USE_GUN)
+      Keyb::UpdateToPC();
+      Gun::UpdateToPC();
 #endif
       break;
   }
@@ -553,6 +733,9 @@ void loop() {
 
   // Read/Write all IOs
   RefreshIOs();
+  // Board actions pressed by inputs, then eeprom writes they started
+  Mapping::RunSystem();
+  Config::RunBackgroundSave();
 
   //---------------------------------------------------------------------------
   // Emulation of keyboard/mouse/joystick
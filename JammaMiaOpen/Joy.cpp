@@ -37,45 +37,33 @@ void Setup() {
                                  false,                                   // Brake
                                  false);                                  // Steering
 
-    pJoystick[i]->setXAxisRange(0, 1023);
-    pJoystick[i]->setYAxisRange(0, 1023);
-    pJoystick[i]->setZAxisRange(0, 1023);
-    pJoystick[i]->setRxAxisRange(0, 1023);
-    pJoystick[i]->setRyAxisRange(0, 1023);
-    pJoystick[i]->setRzAxisRange(0, 1023);
-    pJoystick[i]->setRudderRange(0, 1023);
-    pJoystick[i]->setThrottleRange(0, 1023);
+    pJoystick[i]->setXAxisRange(JOY_MAXNEG_VAL, JOY_MAXPOS_VAL);
+    pJoystick[i]->setYAxisRange(JOY_MAXNEG_VAL, JOY_MAXPOS_VAL);
+    pJoystick[i]->setZAxisRange(JOY_MAXNEG_VAL, JOY_MAXPOS_VAL);
+    pJoystick[i]->setRxAxisRange(JOY_MAXNEG_VAL, JOY_MAXPOS_VAL);
+    pJoystick[i]->setRyAxisRange(JOY_MAXNEG_VAL, JOY_MAXPOS_VAL);
+    pJoystick[i]->setRzAxisRange(JOY_MAXNEG_VAL, JOY_MAXPOS_VAL);
+    pJoystick[i]->setRudderRange(JOY_MAXNEG_VAL, JOY_MAXPOS_VAL);
+    pJoystick[i]->setThrottleRange(JOY_MAXNEG_VAL, JOY_MAXPOS_VAL);
     pJoystick[i]->begin(false);
   }
 }
 
-void BtnPress(byte button) {
-  int p = button >> 7;
-  int btn = button & 0b01111111;
-  if (pJoystick[p] == nullptr)
+// Press/release a button of a player
+void Button(uint8_t player, uint8_t btn, bool pressed) {
+  if (pJoystick[player] == nullptr)
     return;
-  pJoystick[p]->pressButton(btn);
+  if (pressed) {
+    pJoystick[player]->pressButton(btn);
+  } else {
+    pJoystick[player]->releaseButton(btn);
+  }
   StateHasChanged = true;
 
 #ifdef DEBUG_PRINTF
   Serial.print(F("Mjoy P"));
-  Serial.print(p, HEX);
-  Serial.print(F(" press btn "));
-  Serial.println(btn, HEX);
-#endif
-}
-
-void BtnRelease(byte button) {
-  int p = button >> 7;
-  int btn = button & 0b01111111;
-  if (pJoystick[p] == nullptr)
-    return;
-  pJoystick[p]->releaseButton(btn);
-  StateHasChanged = true;
-#ifdef DEBUG_PRINTF
-  Serial.print(F("Mjoy P"));
-  Serial.print(p + 1, HEX);
-  Serial.print(F(" release btn "));
+  Serial.print(player + 1, HEX);
+  Serial.print(pressed ? F(" press btn ") : F(" release btn "));
   Serial.println(btn, HEX);
 #endif
 }
@@ -103,27 +91,25 @@ const int16_t DirectionToHATTable[] = {
   -1,   // 0b1111: UP+DOWN+LEFT+RIGHT IMPOSSIBLE
 };
 
-void SetHATSwitch(byte hatdirection, bool enable) {
-  int p = hatdirection >> 7;
-  if (pJoystick[p] == nullptr)
+// Set/clear direction bits (see HATDirections) of a HAT switch of a player
+void HAT(uint8_t player, uint8_t hatsw, byte direction, bool enable) {
+  if (pJoystick[player] == nullptr)
     return;
-  byte hatsw = hatdirection >> 5 & 0b11;
-  byte direction = hatdirection & 0b00001111;
   if (enable) {
     // set bit in HATDirections
-    HATDirections[p][hatsw] |= direction;
+    HATDirections[player][hatsw] |= direction;
   } else {
     // Clear bit in HATDirections
-    HATDirections[p][hatsw] &= ~(direction);
+    HATDirections[player][hatsw] &= ~(direction);
   }
-  direction = HATDirections[p][hatsw] & 0b1111;
+  direction = HATDirections[player][hatsw] & 0b1111;
   int angle = DirectionToHATTable[direction];
-  pJoystick[p]->setHatSwitch(hatsw, angle);
+  pJoystick[player]->setHatSwitch(hatsw, angle);
   StateHasChanged = true;
 
 #ifdef DEBUG_PRINTF
   Serial.print(F("Mjoy P"));
-  Serial.print(p + 1, HEX);
+  Serial.print(player + 1, HEX);
   Serial.print(F(" HAT dir "));
   Serial.print(direction, HEX);
   Serial.print(F(" Angle "));
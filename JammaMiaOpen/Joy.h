@@ -15,17 +15,16 @@ enum HATDirections : byte {
 };
 
 // Maximum positive analog value for an axis
-#define JOY_MAXPOS_VAL (1023)
+#define JOY_MAXPOS_VAL (AIN_MAX_VAL)
 // centered analog value for an axis
-#define JOY_CENTERED_VAL (511)
+#define JOY_CENTERED_VAL (AIN_CENTERED_VAL)
 // Maximum negative analog value for an axis
 #define JOY_MAXNEG_VAL (0)
 
 void Setup();
-void BtnPress(byte button);
-void BtnRelease(byte  button);
+void Button(uint8_t player, uint8_t btn, bool pressed);
 void SetAxis(byte axis, int16_t value);
-void SetHATSwitch(byte hatdirection, bool enable);
+void HAT(uint8_t player, uint8_t hatsw, byte direction, bool enable);
 void UpdateToPC();
 }
 
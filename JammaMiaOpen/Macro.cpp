@@ -0,0 +1,173 @@
+/*
+  Timed macros
+
+  A macro is a list of press/release steps stored in eeprom, each step
+  giving the delay before the next one. Steps are read from eeprom when
+  played, so macros cost no RAM besides the playing ones.
+
+  Playing macros are timers of a small timer wheel: WHEEL_SLOTS slots of
+  WHEEL_SLOT_TICKS hardware ticks. A timer is put in the slot of its due
+  time, with the number of wheel rounds to wait for longer delays. The
+  main loop advances the wheel up to the current tick, only looking at
+  the timers of the elapsed slots, and injects the steps in the usual
+  press/release paths: nothing blocks the loop.
+*/
+#include "Macro.h"
+#include "Tick.h"
+#include "Mapping.h"
+
+namespace Macro {
+
+// Maximum number of macros playing at once
+#define MAX_PLAYING (4)
+#define WHEEL_SLOTS (32)
+#define WHEEL_SLOTS_BITS (5)
+// One slot is 4 hardware ticks (~4ms), the unit of step delays
+#define WHEEL_SLOT_TICKS_BITS (2)
+// Slot time is the tick count divided by the slot length, wrapping
+#define WHEEL_TIME_MASK (0xFFFF >> WHEEL_SLOT_TICKS_BITS)
+
+typedef struct {
+  // Next timer in the same slot, +1 (0 for none)
+  uint8_t Next;
+  // Wheel rounds to wait before being due
+  uint8_t Rounds;
+  uint8_t Macro;
+  // Next step to play
+  uint8_t Step;
+} Timer;
+
+static Timer Timers[MAX_PLAYING];
+// Timers in use, bit k for timer k
+static uint8_t UsedMask = 0;
+// First timer of each slot, +1 (0 for none)
+static uint8_t Slots[WHEEL_SLOTS];
+// Last processed slot time
+static uint16_t Cursor = 0;
+
+static uint16_t SlotTime() {
+  return Tick::Now() >> WHEEL_SLOT_TICKS_BITS;
+}
+
+static void Schedule(uint8_t k, uint8_t delay) {
+  uint8_t slot = (Cursor + delay) & (WHEEL_SLOTS - 1);
+  // A full round brings back to the same slot
+  Timers[k].Rounds = (delay - 1) >> WHEEL_SLOTS_BITS;
+  Timers[k].Next = Slots[slot];
+  Slots[slot] = k + 1;
+}
+
+// Play steps of a timer until one has a delay, returns that delay or 0 when the macro is over
+static uint8_t Play(Timer &t) {
+  // Bound the number of steps played at once (chained macros could loop)
+  for (uint8_t n = 0; n < NB_MACROS * MACRO_STEPS; n++) {
+    if (t.Step >= MACRO_STEPS)
+      return 0;
+    Config::MacroStep step;
+    Config::LoadMacroStep(t.Macro, t.Step, step);
+    Config::MappingType type = (Config::MappingType)(step.Action & Config::MacroActions::StepTypeMask);
+    if (type == Config::MappingType::Nothing)
+      return 0;
+    if (type == Config::MappingType::Macro) {
+      // Continue with another macro
+      t.Macro = step.MapTo % NB_MACROS;
+      t.Step = 0;
+      continue;
+    }
+    if (step.Action & Config::MacroActions::Press) {
+      Mapping::Inject(type, step.MapTo, true);
+    }
+    if (step.Action & Config::MacroActions::Release) {
+      Mapping::Inject(type, step.MapTo, false);
+    }
+    t.Step++;
+    if (step.Delay > 0) {
+      return step.Delay;
+    }
+  }
+  return 0;
+}
+
+// Start playing a macro, unless already playing
+void Start(uint8_t macro) {
+  if (macro >= NB_MACROS)
+    return;
+  if (UsedMask == 0) {
+    // Idle wheel: restart from current time
+    Cursor = SlotTime();
+  }
+  uint8_t k;
+  for (k = 0; k < MAX_PLAYING; k++) {
+    if ((UsedMask & (1 << k)) && (Timers[k].Macro == macro))
+      return;
+  }
+  for (k = 0; k < MAX_PLAYING; k++) {
+    if (!(UsedMask & (1 << k)))
+      break;
+  }
+  if (k == MAX_PLAYING)
+    return;
+  Timer &t = Timers[k];
+  t.Macro = macro;
+  t.Step = 0;
+  // First steps are played at once
+  uint8_t delay = Play(t);
+  if (delay > 0) {
+    UsedMask |= 1 << k;
+    Schedule(k, delay);
+  }
+}
+
+// Advance the wheel up to current time, playing due steps
+void Run() {
+  if (UsedMask == 0)
+    return;
+  uint16_t now = SlotTime();
+  while (Cursor != now) {
+    Cursor = (Cursor + 1) & WHEEL_TIME_MASK;
+    uint8_t slot = Cursor & (WHEEL_SLOTS - 1);
+    // Detach the list of the slot, then play or re-insert its timers
+    uint8_t next = Slots[slot];
+    Slots[slot] = 0;
+    while (next != 0) {
+      uint8_t k = next - 1;
+      Timer &t = Timers[k];
+      next = t.Next;
+      if (t.Rounds > 0) {
+        t.Rounds--;
+        t.Next = Slots[slot];
+        Slots[slot] = k + 1;
+        continue;
+      }
+      uint8_t delay = Play(t);
+      if (delay > 0) {
+        Schedule(k, delay);
+      } else {
+        UsedMask &= ~(1 << k);
+      }
+    }
+  }
+}
+
+// Stop all macros, releasing what their remaining steps would release
+void Abort() {
+  for (uint8_t k = 0; k < MAX_PLAYING; k++) {
+    if (!(UsedMask & (1 << k)))
+      continue;
+    Timer &t = Timers[k];
+    for (uint8_t s = t.Step; s < MACRO_STEPS; s++) {
+      Config::MacroStep step;
+      Config::LoadMacroStep(t.Macro, s, step);
+      Config::MappingType type = (Config::MappingType)(step.Action & Config::MacroActions::StepTypeMask);
+      if ((type == Config::MappingType::Nothing) || (type == Config::MappingType::Macro))
+        break;
+      if (step.Action & Config::MacroActions::Release) {
+        Mapping::Inject(type, step.MapTo, false);
+      }
+    }
+  }
+  UsedMask = 0;
+  memset(Slots, 0, sizeof(Slots));
+}
+
+}
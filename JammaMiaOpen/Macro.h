@@ -0,0 +1,13 @@
+/*
+  Timed macros played from the main loop with a timer wheel
+*/
+#pragma once
+#include "Config.h"
+
+namespace Macro {
+
+void Start(uint8_t macro);
+void Run();
+void Abort();
+
+}
@@ -0,0 +1,451 @@
+/*
+  Runtime mapping tables compiled from the configuration
+
+  The configuration keeps the user view of a mapping (type and packed
+  player/HAT/direction/button byte). It is compiled once in small hot
+  tables of decoded targets, so that an input event is a table lookup and
+  a direct call to the emulated device.
+
+  Compiling first releases every target held with the previous tables and
+  forgets the state of the inputs: inputs still held are pressed again on
+  their new targets at next refresh, so a remap never leaves a stuck key.
+  Compiling is done from the main loop, between two refreshes of the inputs.
+
+  Digital inputs have one table of targets per layer, an unmapped layer
+  falling back to the normal target at compile time. The layer is chosen
+  on press and remembered per input, so that an input is always released
+  in the layer it was pressed in. Fan-outs add extra targets to an input,
+  in all layers.
+
+  Held targets (keys, buttons, HAT directions, mouse moves, ramps, gun buttons) are reference counted, so
+  that a target shared by several inputs, macros or chords is pressed by
+  the first holder and only released by the last one. The devices still
+  send their reports once per loop.
+*/
+#include "Mapping.h"
+#include "Macro.h"
+#include "Calib.h"
+#include "Ramp.h"
+
+#ifdef USE_KEYB
+#include "Keyb.h"
+#endif
+#ifdef USE_JOY
+#include "Joy.h"
+#endif
+#ifdef USE_MOUSE
+#include "Mou.h"
+#endif
+#ifdef USE_GUN
+#include "Gun.h"
+#endif
+
+namespace Mapping {
+
+#define TARGET_TYPE_MASK (0x0F)
+#define TARGET_HAT(t) (((t).Type >> 5) & 0b11)
+#define TARGET_PLAYER(t) ((t).Type >> 7)
+
+uint32_t DInHeld = 0;
+int8_t AInZone[NB_ANALOGINPUTS];
+uint32_t LayerInputs = 0;
+
+// Targets of digital inputs in layer 0
+static Target DInTargets[NB_DIGITALINPUTS];
+// Targets in layers 1..3, only for inputs with a mapping in one of them
+#define MAX_LAYER_ROWS (12)
+static uint8_t NbLayerRows = 0;
+static uint8_t LayerRowDIn[MAX_LAYER_ROWS];
+static Target LayerRows[MAX_LAYER_ROWS][NB_LAYERS - 1];
+// Layer each input was pressed in: bit i of plane b is bit b of the layer of input i
+static uint32_t DInLayer[2] = { 0, 0 };
+// Shift input, holding layer 1
+static uint32_t ShiftMask = 0;
+// Layers held by momentary keys and toggled, bit n for layer n
+static uint8_t LayersHeld = 0;
+static uint8_t LayersToggled = 0;
+// Active layer: highest held or toggled one
+static uint8_t Layer = 0;
+// Extra targets of digital inputs
+static uint8_t NbFanOuts = 0;
+static uint8_t FanOutDIn[NB_FANOUTS];
+static Target FanOutTargets[NB_FANOUTS];
+static uint32_t FanOutMask = 0;
+// Board actions pressed, run once inputs are processed: bit n for SystemActions n
+static uint8_t SystemPending = 0;
+
+// Held targets and their number of holders, for up to 24 targets held
+// at once: more presses are refused until a target is released
+#define MAX_HELD_TARGETS (24)
+typedef struct {
+  Target T;
+  uint8_t Count;
+} Holder;
+static Holder Held[MAX_HELD_TARGETS];
+static uint8_t NbHeld = 0;
+// Negative and positive targets of digitalized analog inputs
+static Target AInTargets[NB_ANALOGINPUTS][2];
+
+static const Target &DInTarget(uint8_t din, uint8_t layer) {
+  if (layer > 0) {
+    for (uint8_t r = 0; r < NbLayerRows; r++) {
+      if (LayerRowDIn[r] == din)
+        return LayerRows[r][layer - 1];
+    }
+  }
+  return DInTargets[din];
+}
+
+static void UpdateLayer() {
+  uint8_t layers = LayersHeld | LayersToggled;
+  uint8_t l = NB_LAYERS - 1;
+  while ((l > 0) && !(layers & (1 << l))) {
+    l--;
+  }
+  Layer = l;
+}
+
+static void Apply(const Target &t, bool state) {
+  switch (t.Type & TARGET_TYPE_MASK) {
+#ifdef USE_KEYB
+    case Config::MappingType::Key:
+      if (state) {
+        Keyb::Press(t.Code);
+      } else {
+        Keyb::Release(t.Code);
+      }
+      break;
+#endif
+#ifdef USE_JOY
+    case Config::MappingType::JoyButton:
+      Joy::Button(TARGET_PLAYER(t), t.Code, state);
+      break;
+    case Config::MappingType::JoyDirHAT:
+      Joy::HAT(TARGET_PLAYER(t), TARGET_HAT(t), t.Code, state);
+      break;
+#endif
+#ifdef USE_MOUSE
+    case Config::MappingType::MouseButton:
+      Mou::Button(TARGET_PLAYER(t), t.Code, state);
+      break;
+    case Config::MappingType::MouseAxis:
+      Mou::Hold(t.Code, state);
+      break;
+#endif
+#ifdef USE_GUN
+    case Config::MappingType::Gun:
+      Gun::Button(TARGET_PLAYER(t), t.Code, state);
+      break;
+#endif
+    case Config::MappingType::Macro:
+      if (state) {
+        Macro::Start(t.Code);
+      }
+      break;
+    case Config::MappingType::System:
+      // Board actions change the configuration: not while processing inputs
+      if (state && (t.Code < 8)) {
+        SystemPending |= 1 << t.Code;
+      }
+      break;
+    case Config::MappingType::Ramp:
+      Ramp::Hold(t.Code, state);
+      break;
+    case Config::MappingType::Layer:
+      {
+        uint8_t bit = 1 << (t.Code & Config::LayerKeys::LayerNumberMask);
+        if (t.Code & Config::LayerKeys::LayerToggle) {
+          if (state) {
+            LayersToggled ^= bit;
+          }
+        } else if (state) {
+          LayersHeld |= bit;
+        } else {
+          LayersHeld &= ~bit;
+        }
+        UpdateLayer();
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+// Count holders of a target, true when it must be pressed/released
+static bool Count(const Target &t, bool state) {
+  uint8_t k;
+  for (k = 0; k < NbHeld; k++) {
+    if ((Held[k].T.Type == t.Type) && (Held[k].T.Code == t.Code))
+      break;
+  }
+  if (state) {
+    if (k < NbHeld) {
+      Held[k].Count++;
+      return false;
+    }
+    // Table full: press refused, so that it is never left stuck
+    if (NbHeld >= MAX_HELD_TARGETS)
+      return false;
+    Held[NbHeld].T = t;
+    Held[NbHeld].Count = 1;
+    NbHeld++;
+    return true;
+  }
+  // Not held: releasing it is harmless
+  if (k == NbHeld)
+    return true;
+  if (--Held[k].Count > 0)
+    return false;
+  Held[k] = Held[--NbHeld];
+  return true;
+}
+
+// Press/release a target through the holders table
+static void Set(const Target &t, bool state) {
+  switch (t.Type & TARGET_TYPE_MASK) {
+    case Config::MappingType::JoyDirHAT:
+      {
+        // Each direction of the HAT is held on its own
+        Target dir = t;
+        for (byte b = 1; b < 0x10; b <<= 1) {
+          if (t.Code & b) {
+            dir.Code = b;
+            if (Count(dir, state)) {
+              Apply(dir, state);
+            }
+          }
+        }
+      }
+      return;
+    case Config::MappingType::Key:
+    case Config::MappingType::JoyButton:
+    case Config::MappingType::MouseButton:
+    case Config::MappingType::MouseAxis:
+    case Config::MappingType::Ramp:
+    case Config::MappingType::Gun:
+      if (!Count(t, state))
+        return;
+      break;
+    default:
+      break;
+  }
+  Apply(t, state);
+}
+
+// Decode a configured type and mapping byte
+static Target Decode(Config::MappingType type, byte mapping) {
+  Target t = { Config::MappingType::Nothing, 0 };
+  byte player = mapping & 0x80;
+  switch (type) {
+#ifdef USE_KEYB
+    case Config::MappingType::Key:
+      if (mapping != 0) {
+        t.Type = type;
+        t.Code = mapping;
+      }
+      break;
+#endif
+#ifdef USE_JOY
+    case Config::MappingType::JoyButton:
+      t.Type = type | player;
+      t.Code = mapping & 0x7F;
+      break;
+    case Config::MappingType::JoyDirHAT:
+      t.Type = type | player | (mapping & 0x60);
+      t.Code = mapping & 0x0F;
+      break;
+#endif
+#ifdef USE_MOUSE
+    case Config::MappingType::MouseButton:
+      t.Type = type | player;
+      t.Code = Mou::ButtonMask(mapping);
+      break;
+    case Config::MappingType::MouseAxis:
+      t.Type = type;
+      t.Code = mapping;
+      break;
+#endif
+#ifdef USE_GUN
+    case Config::MappingType::Gun:
+      t.Type = type | player;
+      t.Code = Gun::ButtonMask(mapping);
+      break;
+#endif
+    case Config::MappingType::Macro:
+    case Config::MappingType::System:
+    case Config::MappingType::Ramp:
+      t.Type = type;
+      t.Code = mapping;
+      break;
+    case Config::MappingType::Layer:
+      t.Type = type;
+      t.Code = mapping & (Config::LayerKeys::LayerNumberMask | Config::LayerKeys::LayerToggle);
+      break;
+    default:
+      break;
+  }
+  return t;
+}
+
+// Release all held targets and forget inputs and held layers state,
+// toggled layers are kept
+static void ReleaseAll() {
+  uint32_t held = DInHeld;
+  for (uint8_t i = 0; held != 0; i++, held >>= 1) {
+    if (held & 1) {
+      DigitalInput(i, false);
+    }
+  }
+  DInHeld = 0;
+  LayersHeld = 0;
+  LayersToggled &= ((1 << NB_LAYERS) - 1) & ~1;
+  UpdateLayer();
+  for (uint8_t i = 0; i < NB_ANALOGINPUTS; i++) {
+    AnalogZone(i, 0);
+  }
+  // Targets still held by macros or chords
+  for (uint8_t k = 0; k < NbHeld; k++) {
+    Apply(Held[k].T, false);
+  }
+  NbHeld = 0;
+}
+
+// Build hot tables from the configuration
+void Compile() {
+  Macro::Abort();
+  ReleaseAll();
+#ifdef USE_MOUSE
+  Mou::Stop();
+#endif
+  uint32_t layerinputs = 0;
+  uint8_t rows = 0;
+  for (uint8_t i = 0; i < NB_DIGITALINPUTS; i++) {
+    auto &dinDB = Config::ConfigFile.DigitalInB[i];
+    DInTargets[i] = Decode(dinDB.Type, dinDB.MapTo);
+    if (DInTargets[i].Type == Config::MappingType::Layer) {
+      // Layer keys have the same target in all layers
+      layerinputs |= (uint32_t)1 << i;
+      continue;
+    }
+    bool layered = false;
+    for (uint8_t l = 0; l < NB_LAYERS - 1; l++) {
+      layered |= (dinDB.MapToLayer[l] != 0);
+    }
+    if (!layered || (rows >= MAX_LAYER_ROWS))
+      continue;
+    LayerRowDIn[rows] = i;
+    for (uint8_t l = 1; l < NB_LAYERS; l++) {
+      byte mapping = dinDB.MapToLayer[l - 1];
+      // No mapping in layer: same target as normal one
+      LayerRows[rows][l - 1] = (mapping == 0) ? DInTargets[i] : Decode(dinDB.Type, mapping);
+    }
+    rows++;
+  }
+  NbLayerRows = rows;
+  uint8_t nb = 0;
+  uint32_t fanoutmask = 0;
+  for (uint8_t k = 0; k < NB_FANOUTS; k++) {
+    auto &fanDB = Config::ConfigFile.FanOuts[k];
+    if ((fanDB.DIn == 0) || (fanDB.DIn > NB_DIGITALINPUTS))
+      continue;
+    FanOutDIn[nb] = fanDB.DIn - 1;
+    FanOutTargets[nb] = Decode(fanDB.Type, fanDB.MapTo);
+    uint32_t bit = (uint32_t)1 << FanOutDIn[nb];
+    fanoutmask |= bit;
+    if (FanOutTargets[nb].Type == Config::MappingType::Layer) {
+      layerinputs |= bit;
+    }
+    nb++;
+  }
+  NbFanOuts = nb;
+  FanOutMask = fanoutmask;
+  uint8_t shift = Config::ConfigFile.ShiftInput;
+  ShiftMask = ((shift > 0) && (shift <= NB_DIGITALINPUTS)) ? (uint32_t)1 << (shift - 1) : 0;
+  LayerInputs = layerinputs | ShiftMask;
+  for (uint8_t i = 0; i < NB_ANALOGINPUTS; i++) {
+    auto &ainDB = Config::ConfigFile.AnalogInDB[i];
+    AInTargets[i][0] = Decode(ainDB.Type, ainDB.MapToNeg);
+    AInTargets[i][1] = Decode(ainDB.Type, ainDB.MapToPos);
+    // Axes are not digitalized
+    if (IsAxis(ainDB.Type)) {
+      AInTargets[i][0].Type = Config::MappingType::Nothing;
+      AInTargets[i][1].Type = Config::MappingType::Nothing;
+    }
+  }
+}
+
+// Analog input types reported as axes instead of digitalized
+bool IsAxis(Config::MappingType type) {
+  return (type == Config::MappingType::JoyAxis) || (type == Config::MappingType::MouseAxis) || (type == Config::MappingType::Gun);
+}
+
+// Press/release target of a digital input, in the layer active on press
+void DigitalInput(uint8_t din, bool state) {
+  uint32_t bit = (uint32_t)1 << din;
+  if (bit & ShiftMask) {
+    // Shift input holds layer 1, then has its own target
+    if (state) {
+      LayersHeld |= (1 << 1);
+    } else {
+      LayersHeld &= ~(1 << 1);
+    }
+    UpdateLayer();
+  }
+  uint8_t layer;
+  if (state) {
+    DInHeld |= bit;
+    layer = Layer;
+    DInLayer[0] = (layer & 1) ? (DInLayer[0] | bit) : (DInLayer[0] & ~bit);
+    DInLayer[1] = (layer & 2) ? (DInLayer[1] | bit) : (DInLayer[1] & ~bit);
+  } else {
+    DInHeld &= ~bit;
+    layer = ((DInLayer[0] & bit) ? 1 : 0) | ((DInLayer[1] & bit) ? 2 : 0);
+  }
+  Set(DInTarget(din, layer), state);
+  if (bit & FanOutMask) {
+    for (uint8_t k = 0; k < NbFanOuts; k++) {
+      if (FanOutDIn[k] == din) {
+        Set(FanOutTargets[k], state);
+      }
+    }
+  }
+}
+
+// Press/release targets of a digitalized analog input when it changes of zone
+void AnalogZone(uint8_t ain, int8_t zone) {
+  int8_t last = AInZone[ain];
+  if (zone == last)
+    return;
+  AInZone[ain] = zone;
+  // Release before press, so that a target shared by both sides ends pressed
+  if (last < 0) {
+    Set(AInTargets[ain][0], false);
+  } else if (last > 0) {
+    Set(AInTargets[ain][1], false);
+  }
+  if (zone < 0) {
+    Set(AInTargets[ain][0], true);
+  } else if (zone > 0) {
+    Set(AInTargets[ain][1], true);
+  }
+}
+
+// Press/release a target given by its configured type and mapping value, for macros and chords
+void Inject(Config::MappingType type, byte mapping, bool state) {
+  Set(Decode(type, mapping), state);
+}
+
+// Run board actions pressed since last call
+void RunSystem() {
+  uint8_t pending = SystemPending;
+  SystemPending = 0;
+  if (pending & (1 << Config::SystemActions::CalibrationToggle)) {
+    if (Calib::IsRunning()) {
+      Calib::Stop(true);
+    } else {
+      Calib::Start();
+    }
+  }
+}
+
+}
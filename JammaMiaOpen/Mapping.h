@@ -0,0 +1,31 @@
+/*
+  Runtime mapping tables compiled from the configuration
+*/
+#pragma once
+#include "Config.h"
+
+namespace Mapping {
+
+// Decoded target of an input
+typedef struct __attribute__((__packed__)) {
+  // MappingType in bits 0..3, HAT number in bits 5..6, player in bit 7
+  byte Type;
+  // Key code, button index, HAT direction bits, mouse button mask or mouse axis
+  byte Code;
+} Target;
+
+// Digital inputs state as last processed
+extern uint32_t DInHeld;
+// Digitalized analog inputs state as last processed: -1 below dead zone, 0 inside, +1 above
+extern int8_t AInZone[NB_ANALOGINPUTS];
+// Layer keys and shift input, to be processed before other inputs
+extern uint32_t LayerInputs;
+
+void Compile();
+void DigitalInput(uint8_t din, bool state);
+void AnalogZone(uint8_t ain, int8_t zone);
+bool IsAxis(Config::MappingType type);
+void Inject(Config::MappingType type, byte mapping, bool state);
+void RunSystem();
+
+}
@@ -0,0 +1,321 @@
+/*
+  Register-level TWI driver for the two MCP23017 IOs expanders
+  Talks directly to the Atmega32u4 TWI registers: register reads use a
+  repeated start and bytes go straight to the caller's buffer.
+  The TWI interrupt is used by the background scan, so the Wire library
+  must not be linked with this driver.
+*/
+#include "Mcp.h"
+
+#ifdef USE_MCP_TWI_DRIVER
+
+#include <util/twi.h>
+
+namespace Mcp {
+
+// Busy wait loops before giving up on a TWI operation (~ 1ms)
+#define TWI_TIMEOUT (4000)
+
+#ifdef USE_MCP_ASYNC_SCAN
+// A scan taking longer than this is considered lost
+#define SCAN_TIMEOUT_US (2000UL)
+// TWCR value to continue an interrupt driven transfer
+#define TWCR_ASYNC (_BV(TWINT) | _BV(TWEN) | _BV(TWIE))
+
+#ifdef USE_MCP_CAPTURE
+// INTF, INTCAP and GPIO
+#define SCAN_FIRST_REG MCP_REG_INTFA
+#define SCAN_OFFSET (0)
+#else
+// GPIO only
+#define SCAN_FIRST_REG MCP_REG_GPIOA
+#define SCAN_OFFSET (4)
+#endif
+#define SCAN_LEN (sizeof(ChipSnapshot) - SCAN_OFFSET)
+
+// Transactions chained by a scan, write are skipped when no output changed
+enum ScanSteps : uint8_t {
+  ReadMCP1 = 0,
+  ReadMCP2,
+  WriteMCP1,
+  WriteMCP2,
+  ScanDone,
+};
+
+// Double buffered snapshots: ISR fills the back one, then flips
+static ChipSnapshot Snapshots[2][2];
+static volatile uint8_t FrontSnapshot = 0;
+static volatile bool SnapshotReady = false;
+static volatile bool ScanBusy = false;
+// Scan dropped before its end, reads and writes are lost
+static volatile bool ScanDropped = false;
+static uint8_t OLAT[2][2];
+static uint8_t WritePending = 0;
+static uint8_t Step;
+static bool ReadPhase;
+static uint8_t *BytePtr;
+static uint8_t ByteCount;
+static uint32_t ScanStart_us;
+static uint16_t LastScanTime_us;
+#endif
+
+// Wait for current TWI operation to complete
+static bool Wait() {
+  uint16_t timeout = TWI_TIMEOUT;
+  while (!(TWCR & _BV(TWINT))) {
+    if (--timeout == 0) {
+      // Bus locked: reset the TWI unit
+      TWCR = 0;
+      TWCR = _BV(TWEN);
+      return false;
+    }
+  }
+  return true;
+}
+
+static void Stop() {
+  TWCR = _BV(TWINT) | _BV(TWSTO) | _BV(TWEN);
+  // Stop condition is executed when TWSTO is cleared
+  uint16_t timeout = TWI_TIMEOUT;
+  while ((TWCR & _BV(TWSTO)) && --timeout)
+    ;
+}
+
+// Start (or repeated start) and send address, returns true if slave acked
+static bool Start(uint8_t sla) {
+  TWCR = _BV(TWINT) | _BV(TWSTA) | _BV(TWEN);
+  if (!Wait())
+    return false;
+  uint8_t status = TW_STATUS;
+  if (status != TW_START && status != TW_REP_START)
+    return false;
+  TWDR = sla;
+  TWCR = _BV(TWINT) | _BV(TWEN);
+  if (!Wait())
+    return false;
+  status = TW_STATUS;
+  return (status == TW_MT_SLA_ACK) || (status == TW_MR_SLA_ACK);
+}
+
+static bool Send(uint8_t data) {
+  TWDR = data;
+  TWCR = _BV(TWINT) | _BV(TWEN);
+  if (!Wait())
+    return false;
+  return TW_STATUS == TW_MT_DATA_ACK;
+}
+
+void Setup(uint32_t frequency) {
+  // No prescaler, SCL = F_CPU / (16 + 2*TWBR)
+  TWSR = 0;
+  TWBR = (uint8_t)(((F_CPU / frequency) - 16) / 2);
+  TWCR = _BV(TWEN);
+}
+
+bool ReadRegs(uint8_t addr, uint8_t reg, uint8_t *data, uint8_t len) {
+  bool ok = Start(addr << 1 | TW_WRITE) && Send(reg) && Start(addr << 1 | TW_READ);
+  if (ok) {
+    while (len > 0) {
+      // ACK all bytes but the last one
+      TWCR = _BV(TWINT) | _BV(TWEN) | (len > 1 ? _BV(TWEA) : 0);
+      if (!Wait()) {
+        ok = false;
+        break;
+      }
+      *data++ = TWDR;
+      len--;
+    }
+  }
+  Stop();
+  return ok;
+}
+
+bool WriteRegs(uint8_t addr, uint8_t reg, const uint8_t *data, uint8_t len) {
+  bool ok = Start(addr << 1 | TW_WRITE) && Send(reg);
+  while (ok && len > 0) {
+    ok = Send(*data++);
+    len--;
+  }
+  Stop();
+  return ok;
+}
+
+// Read A/B register pair, A being the LSB
+bool Read16(uint8_t addr, uint8_t reg, uint16_t &value) {
+  uint8_t data[2];
+  if (!ReadRegs(addr, reg, data, 2))
+    return false;
+  value = data[0] | ((uint16_t)data[1] << 8);
+  return true;
+}
+
+// Write A/B register pair, A being the LSB
+bool Write16(uint8_t addr, uint8_t reg, uint16_t value) {
+  uint8_t data[2] = { (uint8_t)value, (uint8_t)(value >> 8) };
+  return WriteRegs(addr, reg, data, 2);
+}
+
+#ifdef USE_MCP_ASYNC_SCAN
+
+static uint8_t StepAddr() {
+  return (Step == ReadMCP1 || Step == WriteMCP1) ? MCP1_ADDR : MCP2_ADDR;
+}
+
+// Chain next transaction with a repeated start, or end the scan
+static void NextStep() {
+  Step++;
+  while ((Step == WriteMCP1 && !(WritePending & 1)) || (Step == WriteMCP2 && !(WritePending & 2))) {
+    Step++;
+  }
+  if (Step < ScanDone) {
+    ReadPhase = false;
+    TWCR = TWCR_ASYNC | _BV(TWSTA);
+  } else {
+    TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWSTO);
+    // Publish the new snapshot
+    FrontSnapshot ^= 1;
+    SnapshotReady = true;
+    ScanBusy = false;
+    LastScanTime_us = (uint16_t)(micros() - ScanStart_us);
+  }
+}
+
+ISR(TWI_vect) {
+  switch (TW_STATUS) {
+    case TW_START:
+    case TW_REP_START:
+      TWDR = (StepAddr() << 1) | (ReadPhase ? TW_READ : TW_WRITE);
+      TWCR = TWCR_ASYNC;
+      break;
+    case TW_MT_SLA_ACK:
+      // Register address, then data to write if any
+      if (Step < WriteMCP1) {
+        TWDR = SCAN_FIRST_REG;
+        ByteCount = 0;
+      } else {
+        TWDR = MCP_REG_OLATA;
+        BytePtr = OLAT[Step - WriteMCP1];
+        ByteCount = 2;
+      }
+      TWCR = TWCR_ASYNC;
+      break;
+    case TW_MT_DATA_ACK:
+      if (ByteCount > 0) {
+        TWDR = *BytePtr++;
+        ByteCount--;
+        TWCR = TWCR_ASYNC;
+      } else if (Step < WriteMCP1) {
+        // Register selected, repeated start to read it
+        ReadPhase = true;
+        BytePtr = (uint8_t *)&Snapshots[FrontSnapshot ^ 1][Step] + SCAN_OFFSET;
+        ByteCount = SCAN_LEN;
+        TWCR = TWCR_ASYNC | _BV(TWSTA);
+      } else {
+        NextStep();
+      }
+      break;
+    case TW_MR_SLA_ACK:
+      // ACK all bytes but the last one
+      TWCR = TWCR_ASYNC | (ByteCount > 1 ? _BV(TWEA) : 0);
+      break;
+    case TW_MR_DATA_ACK:
+      *BytePtr++ = TWDR;
+      ByteCount--;
+      TWCR = TWCR_ASYNC | (ByteCount > 1 ? _BV(TWEA) : 0);
+      break;
+    case TW_MR_DATA_NACK:
+      *BytePtr++ = TWDR;
+      NextStep();
+      break;
+    default:
+      // NACK, arbitration lost or bus error: drop this scan
+      TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWSTO);
+      ScanBusy = false;
+      ScanDropped = true;
+      break;
+  }
+}
+
+// Reset the TWI unit when a scan never ended
+static void CheckTimeout() {
+  if (ScanBusy && ((uint32_t)(micros() - ScanStart_us) >= SCAN_TIMEOUT_US)) {
+    // Scan lost: reset the TWI unit
+    TWCR = 0;
+    TWCR = _BV(TWEN);
+    ScanBusy = false;
+    ScanDropped = true;
+  }
+}
+
+// Start a non-blocking scan: read both expanders, then write OLAT of the
+// expanders selected in writeMask (bit 0 MCP1, bit 1 MCP2).
+// Returns false if a scan is running or last snapshot was not consumed yet.
+bool StartScan(const uint16_t olat[2], uint8_t writeMask) {
+  CheckTimeout();
+  if (ScanBusy || SnapshotReady) {
+    return false;
+  }
+  // Wait for stop condition of previous scan
+  uint16_t timeout = TWI_TIMEOUT;
+  while ((TWCR & _BV(TWSTO)) && --timeout)
+    ;
+  for (uint8_t i = 0; i < 2; i++) {
+    OLAT[i][0] = (uint8_t)olat[i];
+    OLAT[i][1] = (uint8_t)(olat[i] >> 8);
+  }
+  WritePending = writeMask;
+  Step = ReadMCP1;
+  ReadPhase = false;
+  ScanBusy = true;
+  ScanStart_us = micros();
+  TWCR = TWCR_ASYNC | _BV(TWSTA);
+  return true;
+}
+
+// Copy last completed scan, returns false if there is no new one
+bool GetSnapshot(ChipSnapshot snap[2]) {
+  if (!SnapshotReady) {
+    return false;
+  }
+  // No scan can start before SnapshotReady is cleared: front is stable
+  memcpy(snap, Snapshots[FrontSnapshot], sizeof(Snapshots[0]));
+  SnapshotReady = false;
+  return true;
+}
+
+uint16_t ScanTime_us() {
+  return LastScanTime_us;
+}
+
+// True once after a scan was dropped (bus error or timeout): the caller
+// must read the inputs and write the outputs again
+bool ScanFailed() {
+  CheckTimeout();
+  bool dropped = ScanDropped;
+  ScanDropped = false;
+  return dropped;
+}
+
+#endif
+
+// outputs: bitmask of output pins, all others are inputs with pull-up
+// interrupts: enable interrupt-on-change of inputs on mirrored open-drain INT pins
+bool ConfigureChip(uint8_t addr, uint16_t outputs, bool interrupts) {
+  uint16_t inputs = ~outputs;
+  uint8_t iocon = interrupts ? (MCP_IOCON_MIRROR | MCP_IOCON_ODR) : 0;
+  bool ok = WriteRegs(addr, MCP_REG_IOCON, &iocon, 1);
+  ok &= Write16(addr, MCP_REG_OLATA, 0);
+  ok &= Write16(addr, MCP_REG_IODIRA, inputs);
+  ok &= Write16(addr, MCP_REG_GPPUA, inputs);
+  // Compare against previous value
+  ok &= Write16(addr, MCP_REG_INTCONA, 0);
+  ok &= Write16(addr, MCP_REG_GPINTENA, interrupts ? inputs : 0);
+  // Clear any pending interrupt
+  uint16_t gpio;
+  ok &= Read16(addr, MCP_REG_GPIOA, gpio);
+  return ok;
+}
+
+}
+
+#endif
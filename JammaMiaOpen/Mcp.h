@@ -0,0 +1,53 @@
+/*
+  Register-level TWI driver for the two MCP23017 IOs expanders
+*/
+#pragma once
+#include "Config.h"
+
+// I2C addresses of the expanders
+#define MCP1_ADDR (0x20)
+#define MCP2_ADDR (0x21)
+
+// MCP23017 registers address (IOCON.BANK=0, A/B registers are interleaved)
+#define MCP_REG_IODIRA (0x00)
+#define MCP_REG_GPINTENA (0x04)
+#define MCP_REG_INTCONA (0x08)
+#define MCP_REG_IOCON (0x0A)
+#define MCP_REG_GPPUA (0x0C)
+#define MCP_REG_INTFA (0x0E)
+#define MCP_REG_INTCAPA (0x10)
+#define MCP_REG_GPIOA (0x12)
+#define MCP_REG_OLATA (0x14)
+
+// IOCON bits
+#define MCP_IOCON_MIRROR (1 << 6)
+#define MCP_IOCON_ODR (1 << 2)
+
+#ifdef USE_MCP_TWI_DRIVER
+
+namespace Mcp {
+
+void Setup(uint32_t frequency);
+bool ConfigureChip(uint8_t addr, uint16_t outputs, bool interrupts);
+bool ReadRegs(uint8_t addr, uint8_t reg, uint8_t *data, uint8_t len);
+bool WriteRegs(uint8_t addr, uint8_t reg, const uint8_t *data, uint8_t len);
+bool Read16(uint8_t addr, uint8_t reg, uint16_t &value);
+bool Write16(uint8_t addr, uint8_t reg, uint16_t value);
+
+#ifdef USE_MCP_ASYNC_SCAN
+// Registers of one expander captured by a scan, same order as in the chip
+typedef struct __attribute__((__packed__)) {
+  uint16_t IntFlags;
+  uint16_t IntCapture;
+  uint16_t GPIO;
+} ChipSnapshot;
+
+bool StartScan(const uint16_t olat[2], uint8_t writeMask);
+bool GetSnapshot(ChipSnapshot snap[2]);
+uint16_t ScanTime_us();
+bool ScanFailed();
+#endif
+
+}
+
+#endif
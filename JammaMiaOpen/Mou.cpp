@@ -1,9 +1,23 @@
+/*
+  Mouse motion
+
+  Moves of all sources add up until the next report: direct moves
+  (encoders, ramps), velocities of analog deflections and of held digital
+  directions. Velocities are Q8 counts per USB frame, integrated once per
+  frame with their fractional remainder kept, so that slow moves are not
+  lost below one count. Held digital directions accelerate from 1/8 of
+  the maximum speed to the maximum speed, linearly or quadratically.
+
+  At most one report is sent per USB frame (1ms start of frame), counts
+  above a report range being kept for the next one.
+*/
 #include "Mou.h"
 #ifdef USE_MOUSE
 
 #include "Protocol.h"
 #include "Globals.h"
 #include "Utils.h"
+#include "Quadrature.h"
 
 #include <MouseN.h>
 
@@ -13,6 +27,29 @@ namespace Mou {
 
 static bool ButtonStateHasChanged = false;
 static bool MoveStateHasChanged = false;
+// Moves X/Y/W of each player since last report, sent up to a report range
+static int16_t Moves[2][3];
+// Q8 velocities from analog inputs, fractional remainders of moves
+static int16_t Velocity[2][3];
+static int16_t Remainder[2][3];
+// Held digital directions (sum of +1/-1) and frames since held
+static int8_t Held[2][3];
+static uint16_t HeldFrames[2][3];
+// USB frame of last integration
+static uint8_t LastFrame = 0;
+// Frames integrated at most at once, after a pause
+#define MAX_FRAMES (8)
+
+// Player and axis index X/Y/W of an axis mapping, false for none
+static bool AxisIndex(byte axis, uint8_t &p, uint8_t &idx) {
+  p = axis >> 7;
+  switch (axis & 0b111) {
+    case 0b001: idx = 0; return true;
+    case 0b010: idx = 1; return true;
+    case 0b100: idx = 2; return true;
+    default: return false;
+  }
+}
 
 static MouseN_ *pMouse = nullptr;
 
@@ -23,54 +60,46 @@ void Setup() {
   pMouse->begin();
 }
 
-void BtnPress(byte button) {
-  int p = button >> 7;
-  int btn = button & 0b111;  // up to 5 buttons
-  if (pMouse == nullptr)
-    return;
-  // if the mouse is not pressed, press it:
-  if (!pMouse->isPressed(MouseButtons[btn], p == 1)) {
-    pMouse->press(MouseButtons[btn], p == 1);
-  }
-  ButtonStateHasChanged = true;
-#ifdef DEBUG_PRINTF
-  Serial.print(F("Mmouse P"));
-  Serial.print(p + 1);
-  Serial.print(F(" press btn "));
-  Serial.println(btn, HEX);
-#endif
+// Mouse button mask of a button index
+uint8_t ButtonMask(byte button) {
+  return MouseButtons[button & 0b111];  // up to 5 buttons
 }
 
-void BtnRelease(byte button) {
-  int p = button >> 7;
-  int btn = button & 0b111;
+// Press/release buttons (mask) of a player
+void Button(uint8_t player, uint8_t mask, bool pressed) {
   if (pMouse == nullptr)
     return;
-  // if the mouse is pressed, release it:
-  if (pMouse->isPressed(MouseButtons[btn], p == 1)) {
-    pMouse->release(MouseButtons[btn], p == 1);
+  if (pMouse->isPressed(mask, player == 1) != pressed) {
+    if (pressed) {
+      pMouse->press(mask, player == 1);
+    } else {
+      pMouse->release(mask, player == 1);
+    }
   }
   ButtonStateHasChanged = true;
 #ifdef DEBUG_PRINTF
   Serial.print(F("Mmouse P"));
-  Serial.print(p + 1);
-  Serial.print(F(" release btn "));
-  Serial.println(btn, HEX);
+  Serial.print(player + 1);
+  Serial.print(pressed ? F(" press btn ") : F(" release btn "));
+  Serial.println(mask, HEX);
 #endif
 }
 
-void MoveAxis(byte axis, int8_t value) {
+void MoveAxis(byte axis, int16_t value) {
   int p = axis >> 7;
-  int8_t signvalue = ((axis & 0b1000) ? -value : value);
+  int16_t signvalue = ((axis & 0b1000) ? -value : value);
   int dir = axis & 0b111;  // W/Y/X bitmask
 
-  int8_t xDistance = (dir == 0b0001 ? signvalue : 0);
-  int8_t yDistance = (dir == 0b0010 ? signvalue : 0);
-  int8_t wDistance = (dir == 0b0100 ? signvalue : 0);
+  int16_t xDistance = (dir == 0b0001 ? signvalue : 0);
+  int16_t yDistance = (dir == 0b0010 ? signvalue : 0);
+  int16_t wDistance = (dir == 0b0100 ? signvalue : 0);
 
   if (pMouse == nullptr)
     return;
-  pMouse->move(xDistance, yDistance, wDistance, p == 1);
+  // Moves of all sources add up until next report
+  Moves[p][0] += xDistance;
+  Moves[p][1] += yDistance;
+  Moves[p][2] += wDistance;
   MoveStateHasChanged = true;
 #ifdef DEBUG_PRINTF
   Serial.print(F("Mmouse P"));
@@ -84,19 +113,114 @@ void MoveAxis(byte axis, int8_t value) {
 #endif
 }
 
+// Direction held/released by a digital input
+void Hold(byte axis, bool state) {
+  uint8_t p, idx;
+  if (!AxisIndex(axis, p, idx))
+    return;
+  int8_t dir = (axis & 0b1000) ? -1 : 1;
+  Held[p][idx] += state ? dir : -dir;
+  if (state) {
+    // Restart acceleration
+    HeldFrames[p][idx] = 0;
+  }
+}
+
+// Stop moves from analog inputs, when remapped
+void Stop() {
+  memset(Velocity, 0, sizeof(Velocity));
+}
+
+// Deflection of an analog input, 0..AIN_CENTERED_VAL out of its dead zone
+void Deflect(byte axis, uint16_t amount) {
+  uint8_t p, idx;
+  if (!AxisIndex(axis, p, idx))
+    return;
+  int16_t v = ((uint32_t)amount * (Config::ConfigFile.MouseSpeed << 4)) / AIN_CENTERED_VAL;
+  Velocity[p][idx] = (axis & 0b1000) ? -v : v;
+}
+
+// Q8 velocity of held digital directions
+static int16_t HeldVelocity(int8_t held, uint16_t frames) {
+  if (held == 0)
+    return 0;
+  int16_t vmax = Config::ConfigFile.MouseSpeed << 4;
+  int16_t vstart = vmax >> 3;
+  uint16_t accel = (uint16_t)(Config::ConfigFile.MouseAccel & Config::MouseAccelOptions::MouseAccelTimeMask) << 4;
+  int16_t v = vmax;
+  if (frames < accel) {
+    // Ratio of acceleration time, Q8
+    uint16_t r = ((uint32_t)frames << 8) / accel;
+    if (Config::ConfigFile.MouseAccel & Config::MouseAccelOptions::MouseAccelQuadratic) {
+      r = (r * r) >> 8;
+    }
+    v = vstart + (((int32_t)(vmax - vstart) * r) >> 8);
+  }
+  return (held > 0) ? v : -v;
+}
+
+// Integrate velocities over elapsed frames
+static void Integrate(uint8_t frames) {
+  for (uint8_t p = 0; p < 2; p++) {
+    for (uint8_t i = 0; i < 3; i++) {
+      int16_t v = Velocity[p][i] + HeldVelocity(Held[p][i], HeldFrames[p][i]);
+      if (Held[p][i] != 0) {
+        HeldFrames[p][i] += frames;
+      }
+      if (v == 0)
+        continue;
+      int32_t accu = Remainder[p][i] + (int32_t)v * frames;
+      // Floor, remainder always positive
+      int16_t counts = accu >> 8;
+      Remainder[p][i] = accu - ((int32_t)counts << 8);
+      if (counts != 0) {
+        Moves[p][i] += counts;
+        MoveStateHasChanged = true;
+      }
+    }
+  }
+}
+
+// Take a report move out of accumulated moves, up to the report range
+static int16_t TakeMove(int16_t &move, int16_t range) {
+  int16_t taken = constrain(move, -range, range);
+  move -= taken;
+  return taken;
+}
+
 void UpdateToPC() {
   if (pMouse == nullptr)
     return;
+  // Once per USB frame
+  uint8_t frame = UDFNUML;
+  uint8_t frames = frame - LastFrame;
+  if (frames == 0)
+    return;
+  LastFrame = frame;
+  Integrate((frames > MAX_FRAMES) ? MAX_FRAMES : frames);
+  // Counts of encoders since last report
+  for (uint8_t k = 0; k < NB_ENCODERS; k++) {
+    int16_t move = Quadrature::Drain(k);
+    if (move != 0) {
+      MoveAxis(Config::ConfigFile.Encoders[k].MapTo, move);
+    }
+  }
   if (ButtonStateHasChanged || MoveStateHasChanged) {
+    MoveStateHasChanged = false;
+    for (uint8_t p = 0; p < 2; p++) {
+      // 16-bit X/Y carry the whole move of a frame, wheel is 8-bit
+      MouseMove x = TakeMove(Moves[p][0], MOUSE_MOVE_MAX);
+      MouseMove y = TakeMove(Moves[p][1], MOUSE_MOVE_MAX);
+      signed char w = TakeMove(Moves[p][2], MOUSE_WHEEL_MAX);
+      pMouse->move(x, y, w, p == 1);
+      // Moves left for next report
+      if ((Moves[p][0] != 0) || (Moves[p][1] != 0) || (Moves[p][2] != 0)) {
+        MoveStateHasChanged = true;
+      }
+    }
     pMouse->sendReport(false);
     pMouse->sendReport(true);
     ButtonStateHasChanged = false;
-    if (MoveStateHasChanged) {
-      // Clear move data
-      pMouse->move(0, 0, 0, false);
-      pMouse->move(0, 0, 0, true);
-      MoveStateHasChanged = false;
-    }
   }
 
 #ifdef DEBUG_PRINTF
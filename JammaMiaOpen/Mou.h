@@ -5,9 +5,12 @@
 
 namespace Mou {
 void Setup();
-void BtnPress(byte button);
-void BtnRelease(byte button);
-void MoveAxis(byte axis, int8_t value);
+uint8_t ButtonMask(byte button);
+void Button(uint8_t player, uint8_t mask, bool pressed);
+void MoveAxis(byte axis, int16_t value);
+void Hold(byte axis, bool state);
+void Deflect(byte axis, uint16_t amount);
+void Stop();
 void UpdateToPC();
 }
 
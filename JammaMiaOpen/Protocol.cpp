@@ -6,6 +6,7 @@
 #include "Globals.h"
 #include "Utils.h"
 #include "CRC.h"
+#include "Calib.h"
 
 //#define WAIT_USB_AT_BOOT
 
@@ -45,6 +46,7 @@ const char PROGMEM sSPC[] = " ";
 const char PROGMEM sE01[] = "E01 Unknown keyw ";
 const char PROGMEM sE02[] = "E02 Key not found ";
 const char PROGMEM sE03[] = "E03 Unknown type for ";
+const char PROGMEM sE04[] = "E04 Bad value for ";
 
 void SendStatusFrame() {
   Serial.write('S');
@@ -70,7 +72,9 @@ void SendStatusFrame() {
     Serial.print((__FlashStringHelper *)sSPC);
   }
 
-  Serial.print(F("rr_us="));
+  Serial.print(F("io_us="));
+  Serial.print(Globals::ioReadTime_us);
+  Serial.print(F(" rr_us="));
   Serial.println(Globals::refreshRate_us);
 }
 
@@ -130,6 +134,9 @@ static const DictionaryParamEntry DictionaryParam[] = {
   { "btns", UINT8, (void *)&Config::ConfigFile.JoyNumberOfButtons },
   { "hats", UINT8, (void *)&Config::ConfigFile.JoyNumberOfHAT },
   { "shift", UINT8, (void *)&Config::ConfigFile.ShiftInput },
+  { "mspeed", UINT8, (void *)&Config::ConfigFile.MouseSpeed },
+  { "maccel", UINT8, (void *)&Config::ConfigFile.MouseAccel },
+  { "goffs", UINT8, (void *)&Config::ConfigFile.GunOffscreen },
 };
 
 // command handlers
@@ -141,6 +148,14 @@ void SetHandler(const String &key);
 void HelpHandler(const String &key);
 void SetDInMapHandler(const String &key);
 void SetAInMapHandler(const String &key);
+void CalibHandler(const String &key);
+void SetCurveHandler(const String &key);
+void SetMacroHandler(const String &key);
+void SetSOCDHandler(const String &key);
+void SetChordHandler(const String &key);
+void SetFanOutHandler(const String &key);
+void SetRotaryHandler(const String &key);
+void SetEncoderHandler(const String &key);
 
 
 
@@ -161,6 +176,14 @@ static const DictionaryKeywordEntry DictionaryKeyword[] = {
   { "help", HelpHandler },          // Help
   { "setdin", SetDInMapHandler },   // Set mapping for digital input
   { "setain", SetAInMapHandler },   // Set mapping for analog input
+  { "calib", CalibHandler },        // Calibration of analog inputs
+  { "setcurve", SetCurveHandler },  // Set custom response curve of analog input
+  { "setmacro", SetMacroHandler },  // Set steps of a macro
+  { "setsocd", SetSOCDHandler },    // Set SOCD cleaning of directions
+  { "setchord", SetChordHandler },  // Set chord of digital inputs
+  { "setfan", SetFanOutHandler },   // Set extra target of a digital input
+  { "setrot", SetRotaryHandler },   // Set rotary joystick
+  { "setenc", SetEncoderHandler },  // Set quadrature encoder
 };
 
 // Handler for "Get parameter" command
@@ -254,6 +277,8 @@ void SetHandler(const String &keyval) {
           }
           break;
       }
+      // Parameters like shift are compiled in the runtime config
+      Config::UpdateRuntimeConfig();
       break;
     }
   }
@@ -303,12 +328,24 @@ void HelpHandler(__attribute__((unused)) const String &keyval) {
   }
 }
 
-// setdin DIN TYPE MAP SHIFTEDMAP NAME
+// Optional trailing field: keep current value when not given
+static void TokenToByte(const String &keyval, int index, uint8_t &value) {
+  String token = Utils::Token(keyval, ' ', index);
+  if (token.length() > 0)
+    value = (uint8_t)Utils::ConvertHexToInt(token, 2);
+}
+
+// setdin DIN TYPE MAP SHIFTEDMAP NAME OPT DEB TURBO LAYER2 LAYER3
 // DIN: digital input number
 // TYPE: type value
 // MAP: map value
-// SHIFTEDMAP: shifted map value (0 for none)
+// SHIFTEDMAP: shifted map value, in layer 1 (0 for none)
 // NAME: Name of input (limited to 3 char)
+// OPT: options (see DInOptions)
+// DEB: debounce time in ms
+// TURBO: autofire rate and duty cycle
+// LAYER2/LAYER3: map value in layers 2 and 3, 0 for same as MAP
+// OPT and following fields are unchanged when not given
 void SetDInMapHandler(const String &keyval) {
   String token = Utils::Token(keyval, ' ', 0);
   uint8_t din = (uint32_t)Utils::ConvertHexToInt(token, 2);
@@ -320,14 +357,20 @@ void SetDInMapHandler(const String &keyval) {
   uint8_t shiftedmap = (uint32_t)Utils::ConvertHexToInt(token, 2);
   Config::ConfigFile.DigitalInB[din].Type = (Config::MappingType)type;
   Config::ConfigFile.DigitalInB[din].MapTo = mapp;
-  Config::ConfigFile.DigitalInB[din].MapToShifted = shiftedmap;
+  Config::ConfigFile.DigitalInB[din].MapToLayer[0] = shiftedmap;
   token = Utils::Token(keyval, ' ', 4);
-  const char *c_name = token.c_str();
-  strncpy(Config::ConfigFile.DigitalInB[din].Name, c_name, 3);
+  Config::SaveName(din, token.c_str());
+  TokenToByte(keyval, 5, Config::ConfigFile.DigitalInB[din].Options);
+  TokenToByte(keyval, 6, Config::ConfigFile.DigitalInB[din].DebounceMs);
+  TokenToByte(keyval, 7, Config::ConfigFile.DigitalInB[din].Turbo);
+  for (uint8_t l = 1; l < NB_LAYERS - 1; l++) {
+    TokenToByte(keyval, 7 + l, Config::ConfigFile.DigitalInB[din].MapToLayer[l]);
+  }
+  Config::UpdateRuntimeConfig();
   Config::PrintDInConfig(din);
 }
 
-// setain AIN TYPE POS NEG DMIN DMAX NAME
+// setain AIN TYPE POS NEG DMIN DMAX NAME FILT THR HYST OPT CURVE SAT
 // AIN: analog input axes number
 // TYPE: type value
 // POS: map value when going positive
@@ -335,6 +378,13 @@ void SetDInMapHandler(const String &keyval) {
 // DMIN: dead zone min value if hat or button, usually 60
 // DMAX: dead zone max value if hat or button, usually 80
 // NAME: Name of analog input (limited to 3 char)
+// FILT: oversampling and filter (see AInFilters)
+// THR: minimum change before an axis is reported again
+// HYST: hysteresis around dead zone limits
+// OPT: options (see AInOptions)
+// CURVE: response curve (see AInCurves)
+// SAT: saturation at both ends
+// FILT and following fields are unchanged when not given
 void SetAInMapHandler(const String &keyval) {
   String token = Utils::Token(keyval, ' ', 0);
   uint8_t ain = (uint32_t)Utils::ConvertHexToInt(token, 2);
@@ -354,11 +404,294 @@ void SetAInMapHandler(const String &keyval) {
   Config::ConfigFile.AnalogInDB[ain].DeadzoneMin = dmin;
   Config::ConfigFile.AnalogInDB[ain].DeadzoneMax = dmax;
   token = Utils::Token(keyval, ' ', 6);
-  const char *c_name = token.c_str();
-  strncpy(Config::ConfigFile.AnalogInDB[ain].Name, c_name, 3);
+  Config::SaveName(NAME_IO_AIN(ain), token.c_str());
+  TokenToByte(keyval, 7, Config::ConfigFile.AnalogInDB[ain].Filter);
+  TokenToByte(keyval, 8, Config::ConfigFile.AnalogInDB[ain].Threshold);
+  TokenToByte(keyval, 9, Config::ConfigFile.AnalogInDB[ain].Hysteresis);
+  TokenToByte(keyval, 10, Config::ConfigFile.AnalogInDB[ain].Options);
+  TokenToByte(keyval, 11, Config::ConfigFile.AnalogInDB[ain].Curve);
+  TokenToByte(keyval, 12, Config::ConfigFile.AnalogInDB[ain].Saturation);
+  Config::UpdateRuntimeConfig();
   Config::PrintAInConfig(ain);
 }
 
+// calib [start|stop|abort|clear]
+// start: learn center (at rest), then min/max of all analog inputs
+// stop: store learnt values in config and save config in eprom
+// abort: stop without storing learnt values
+// clear: forget calibration of all analog inputs
+// without argument, print learnt values: Mcal AIN MIN CENTER MAX
+void CalibHandler(const String &keyval) {
+  if (keyval.equals(F("start"))) {
+    Calib::Start();
+  } else if (keyval.equals(F("stop"))) {
+    Calib::Stop(true);
+  } else if (keyval.equals(F("abort"))) {
+    Calib::Stop(false);
+  } else if (keyval.equals(F("clear"))) {
+    Calib::Clear();
+    Serial.println(F("Mcal clr"));
+  } else {
+    for (uint8_t i = 0; i < NB_ANALOGINPUTS; i++) {
+      auto &ainDB = Config::ConfigFile.AnalogInDB[i];
+      Serial.print(F("Mcal "));
+      Serial.print(i, HEX);
+      Serial.print((__FlashStringHelper *)sSPC);
+      Serial.print(ainDB.CalMin, HEX);
+      Serial.print((__FlashStringHelper *)sSPC);
+      Serial.print(ainDB.CalCenter, HEX);
+      Serial.print((__FlashStringHelper *)sSPC);
+      Serial.println(ainDB.CalMax, HEX);
+    }
+  }
+}
+
+// setcurve AIN P0 P1 .. Pn
+// AIN: analog input axes number
+// P0..Pn: 9 to 17 output values (0..FFF) for inputs evenly spread from full negative to full positive
+// Points are resampled to CURVE_POINTS and saved at once in eprom
+void SetCurveHandler(const String &keyval) {
+  String token = Utils::Token(keyval, ' ', 0);
+  uint8_t ain = (uint32_t)Utils::ConvertHexToInt(token, 2);
+  if (ain >= NB_ANALOGINPUTS) {
+    Serial.print((__FlashStringHelper *)sE04);
+    Serial.println(F("setcurve"));
+    return;
+  }
+  uint16_t given[CURVE_POINTS];
+  uint8_t n = 0;
+  while (n < CURVE_POINTS) {
+    token = Utils::Token(keyval, ' ', n + 1);
+    if (token.length() == 0)
+      break;
+    uint16_t point = (uint16_t)Utils::ConvertHexToInt(token, 4);
+    given[n++] = (point > AIN_MAX_VAL) ? AIN_MAX_VAL : point;
+  }
+  if (n < 9) {
+    Serial.print((__FlashStringHelper *)sE04);
+    Serial.println(F("setcurve"));
+    return;
+  }
+  // Linear resampling of n points to CURVE_POINTS
+  uint16_t points[CURVE_POINTS];
+  for (uint8_t k = 0; k < CURVE_POINTS; k++) {
+    uint16_t p = ((uint32_t)k * (n - 1) * 256) / (CURVE_POINTS - 1);
+    uint8_t idx = p >> 8;
+    if (idx >= n - 1) {
+      points[k] = given[n - 1];
+    } else {
+      int32_t y0 = given[idx];
+      points[k] = y0 + (((int32_t)given[idx + 1] - y0) * (p & 0xFF)) / 256;
+    }
+  }
+  Config::SaveCurve(ain, points);
+  Config::UpdateRuntimeConfig();
+  Serial.print(F("Mcurve "));
+  Serial.print(ain, HEX);
+  for (uint8_t k = 0; k < CURVE_POINTS; k++) {
+    Serial.print((__FlashStringHelper *)sSPC);
+    Serial.print(points[k], HEX);
+  }
+  Serial.println();
+}
+
+// setmacro MACRO S0 S1 .. Sn
+// MACRO: macro number
+// S0..Sn: up to MACRO_STEPS steps AAMMDD, AA action (see MacroActions), MM mapping value, DD delay before next step (x4ms)
+// Steps are saved at once in eprom. Without steps, print the macro: Mmacro MACRO S0 .. Sn
+void SetMacroHandler(const String &keyval) {
+  String token = Utils::Token(keyval, ' ', 0);
+  uint8_t macro = (uint32_t)Utils::ConvertHexToInt(token, 2);
+  if (macro >= NB_MACROS) {
+    Serial.print((__FlashStringHelper *)sE04);
+    Serial.println(F("setmacro"));
+    return;
+  }
+  token = Utils::Token(keyval, ' ', 1);
+  if (token.length() > 0) {
+    for (uint8_t s = 0; s < MACRO_STEPS; s++) {
+      token = Utils::Token(keyval, ' ', s + 1);
+      // Missing steps end the macro
+      uint32_t value = (token.length() > 0) ? Utils::ConvertHexToInt(token, 6) : 0;
+      Config::MacroStep step;
+      step.Action = (byte)(value >> 16);
+      step.MapTo = (byte)(value >> 8);
+      step.Delay = (uint8_t)value;
+      Config::SaveMacroStep(macro, s, step);
+    }
+  }
+  Serial.print(F("Mmacro "));
+  Serial.print(macro, HEX);
+  for (uint8_t s = 0; s < MACRO_STEPS; s++) {
+    Config::MacroStep step;
+    Config::LoadMacroStep(macro, s, step);
+    if ((step.Action & Config::MacroActions::StepTypeMask) == Config::MappingType::Nothing)
+      break;
+    Serial.print((__FlashStringHelper *)sSPC);
+    SendXWord(((uint32_t)step.Action << 16) | ((uint16_t)step.MapTo << 8) | step.Delay, 6);
+  }
+  Serial.println();
+}
+
+// setsocd GROUP UP DOWN LEFT RIGHT POLICY
+// GROUP: SOCD group number
+// UP/DOWN/LEFT/RIGHT: digital input index +1 of each direction, 0 for none
+// POLICY: 0 off, 1 last input wins, 2 neutral, 3 up priority (see SOCDPolicies)
+// Without directions, print the group
+void SetSOCDHandler(const String &keyval) {
+  String token = Utils::Token(keyval, ' ', 0);
+  uint8_t group = (uint32_t)Utils::ConvertHexToInt(token, 2);
+  if (group >= NB_SOCD_GROUPS) {
+    Serial.print((__FlashStringHelper *)sE04);
+    Serial.println(F("setsocd"));
+    return;
+  }
+  token = Utils::Token(keyval, ' ', 1);
+  if (token.length() > 0) {
+    uint8_t dirs[4];
+    for (uint8_t d = 0; d < 4; d++) {
+      token = Utils::Token(keyval, ' ', d + 1);
+      dirs[d] = (uint8_t)Utils::ConvertHexToInt(token, 2);
+      if (dirs[d] > NB_DIGITALINPUTS) {
+        Serial.print((__FlashStringHelper *)sE04);
+        Serial.println(F("setsocd"));
+        return;
+      }
+    }
+    token = Utils::Token(keyval, ' ', 5);
+    uint8_t policy = (uint8_t)Utils::ConvertHexToInt(token, 2);
+    if (policy > Config::SOCDPolicies::UpPriority) {
+      Serial.print((__FlashStringHelper *)sE04);
+      Serial.println(F("setsocd"));
+      return;
+    }
+    auto &socd = Config::ConfigFile.SOCDGroups[group];
+    socd.Up = dirs[0];
+    socd.Down = dirs[1];
+    socd.Left = dirs[2];
+    socd.Right = dirs[3];
+    socd.Policy = (Config::SOCDPolicies)policy;
+    Config::UpdateRuntimeConfig();
+  }
+  Config::PrintSOCDConfig(group);
+}
+
+// setchord CHORD MASK WIN OPT TYPE MAP
+// CHORD: chord number
+// MASK: digital inputs of the chord, bit i for input i, 0 to disable the chord
+// WIN: window (x10ms) to press all inputs, or hold time with LongPress option
+// OPT: options (see ChordOptions)
+// TYPE/MAP: action, same as a digital input
+// Without mask, print the chord
+void SetChordHandler(const String &keyval) {
+  String token = Utils::Token(keyval, ' ', 0);
+  uint8_t chord = (uint32_t)Utils::ConvertHexToInt(token, 2);
+  if (chord >= NB_CHORDS) {
+    Serial.print((__FlashStringHelper *)sE04);
+    Serial.println(F("setchord"));
+    return;
+  }
+  token = Utils::Token(keyval, ' ', 1);
+  if (token.length() > 0) {
+    auto &chordDB = Config::ConfigFile.Chords[chord];
+    chordDB.Mask = Utils::ConvertHexToInt(token, 8);
+    token = Utils::Token(keyval, ' ', 2);
+    chordDB.Window = (uint8_t)Utils::ConvertHexToInt(token, 2);
+    token = Utils::Token(keyval, ' ', 3);
+    chordDB.Options = (uint8_t)Utils::ConvertHexToInt(token, 2);
+    token = Utils::Token(keyval, ' ', 4);
+    chordDB.Type = (Config::MappingType)Utils::ConvertHexToInt(token, 2);
+    token = Utils::Token(keyval, ' ', 5);
+    chordDB.MapTo = (uint8_t)Utils::ConvertHexToInt(token, 2);
+    Config::UpdateRuntimeConfig();
+  }
+  Config::PrintChordConfig(chord);
+}
+
+// setfan FAN DIN TYPE MAP
+// FAN: fan-out number
+// DIN: digital input index +1, 0 to disable the fan-out
+// TYPE/MAP: extra target, same as a digital input
+// Without input, print the fan-out
+void SetFanOutHandler(const String &keyval) {
+  String token = Utils::Token(keyval, ' ', 0);
+  uint8_t fan = (uint32_t)Utils::ConvertHexToInt(token, 2);
+  if (fan >= NB_FANOUTS) {
+    Serial.print((__FlashStringHelper *)sE04);
+    Serial.println(F("setfan"));
+    return;
+  }
+  token = Utils::Token(keyval, ' ', 1);
+  if (token.length() > 0) {
+    auto &fanDB = Config::ConfigFile.FanOuts[fan];
+    fanDB.DIn = (uint8_t)Utils::ConvertHexToInt(token, 2);
+    token = Utils::Token(keyval, ' ', 2);
+    fanDB.Type = (Config::MappingType)Utils::ConvertHexToInt(token, 2);
+    token = Utils::Token(keyval, ' ', 3);
+    fanDB.MapTo = (uint8_t)Utils::ConvertHexToInt(token, 2);
+    Config::UpdateRuntimeConfig();
+  }
+  Config::PrintFanOutConfig(fan);
+}
+
+// setrot ROT DIN OPT POS TYPE MAP CCW
+// ROT: rotary number
+// DIN: first digital input index +1, 0 to disable the rotary
+// OPT: number of inputs and options (see RotaryOptions)
+// POS: number of positions
+// TYPE/MAP/CCW: joy axis in MAP, or step target type and clockwise/counter-clockwise map values
+// Without input, print the rotary
+void SetRotaryHandler(const String &keyval) {
+  String token = Utils::Token(keyval, ' ', 0);
+  uint8_t rot = (uint32_t)Utils::ConvertHexToInt(token, 2);
+  if (rot >= NB_ROTARIES) {
+    Serial.print((__FlashStringHelper *)sE04);
+    Serial.println(F("setrot"));
+    return;
+  }
+  token = Utils::Token(keyval, ' ', 1);
+  if (token.length() > 0) {
+    auto &rotDB = Config::ConfigFile.Rotaries[rot];
+    rotDB.DIn = (uint8_t)Utils::ConvertHexToInt(token, 2);
+    token = Utils::Token(keyval, ' ', 2);
+    rotDB.Options = (uint8_t)Utils::ConvertHexToInt(token, 2);
+    token = Utils::Token(keyval, ' ', 3);
+    rotDB.Positions = (uint8_t)Utils::ConvertHexToInt(token, 2);
+    token = Utils::Token(keyval, ' ', 4);
+    rotDB.Type = (Config::MappingType)Utils::ConvertHexToInt(token, 2);
+    token = Utils::Token(keyval, ' ', 5);
+    rotDB.MapTo = (uint8_t)Utils::ConvertHexToInt(token, 2);
+    token = Utils::Token(keyval, ' ', 6);
+    rotDB.MapToCCW = (uint8_t)Utils::ConvertHexToInt(token, 2);
+    Config::UpdateRuntimeConfig();
+  }
+  Config::PrintRotaryConfig(rot);
+}
+
+// setenc ENC MAP SCALE
+// ENC: encoder number
+// MAP: mouse axis, 0 to disable the encoder
+// SCALE: mouse counts per edge (x1/16), 0 for default
+// Without axis, print the encoder
+void SetEncoderHandler(const String &keyval) {
+  String token = Utils::Token(keyval, ' ', 0);
+  uint8_t enc = (uint32_t)Utils::ConvertHexToInt(token, 2);
+  if (enc >= NB_ENCODERS) {
+    Serial.print((__FlashStringHelper *)sE04);
+    Serial.println(F("setenc"));
+    return;
+  }
+  token = Utils::Token(keyval, ' ', 1);
+  if (token.length() > 0) {
+    auto &encDB = Config::ConfigFile.Encoders[enc];
+    encDB.MapTo = (uint8_t)Utils::ConvertHexToInt(token, 2);
+    token = Utils::Token(keyval, ' ', 2);
+    encDB.Scale = (uint8_t)Utils::ConvertHexToInt(token, 2);
+    Config::UpdateRuntimeConfig();
+  }
+  Config::PrintEncoderConfig(enc);
+}
+
 //-----------------------------------------------------------------------------
 // Interpreter
 //-----------------------------------------------------------------------------
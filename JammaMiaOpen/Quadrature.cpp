@@ -0,0 +1,122 @@
+/*
+  Quadrature encoders
+
+  The A/B lines of an encoder are on port B pins, all sharing the PCINT0
+  interrupt. The ISR reads port B once, and for each encoder looks up the
+  move from its previous and current A/B states, counting all 4 edges of
+  a cycle. Counts are kept scaled (x1/16) in 16-bit counters, so the mouse
+  takes whole counts once per report and leaves the rest for next one:
+  no count is lost whatever the rotation speed.
+
+  Encoder 0 uses pins 9/10 (PB5/PB6), in place of analog outputs 2/3.
+  Encoder 1 uses pins 14/15 (PB3/PB1), in place of TEST2/TILT inputs.
+  Encoders are only enabled with USE_MOUSE, as the mouse drains them.
+*/
+#include "Quadrature.h"
+#include <util/atomic.h>
+
+namespace Quadrature {
+
+static const uint8_t PinA[NB_ENCODERS] = { PINB5, PINB3 };
+static const uint8_t PinB[NB_ENCODERS] = { PINB6, PINB1 };
+// Digital inputs and analog outputs replaced by each encoder
+static const uint8_t DInMask[NB_ENCODERS] = { 0, 0b1100 };
+static const uint8_t AOutMask[NB_ENCODERS] = { 0b1100, 0 };
+
+// Move of each (previous AB, current AB) transition, 0 for none or a missed state
+static const int8_t Steps[16] = { 0, 1, -1, 0, -1, 0, 0, 1, 1, 0, 0, -1, 0, -1, 1, 0 };
+
+static uint8_t Enabled = 0;
+static uint8_t Scale[NB_ENCODERS];
+// ISR state
+static uint8_t State[NB_ENCODERS];
+static volatile int16_t Counts[NB_ENCODERS];
+
+static uint8_t ReadAB(uint8_t pins, uint8_t enc) {
+  return (((pins >> PinA[enc]) & 1) << 1) | ((pins >> PinB[enc]) & 1);
+}
+
+ISR(PCINT0_vect) {
+  uint8_t pins = PINB;
+  for (uint8_t k = 0; k < NB_ENCODERS; k++) {
+    if (!(Enabled & (1 << k)))
+      continue;
+    uint8_t ab = ReadAB(pins, k);
+    int16_t c = Counts[k];
+    int8_t d = Steps[(State[k] << 2) | ab] * (int8_t)Scale[k];
+    // Saturate when counts are not drained
+    if ((d > 0) ? (c <= INT16_MAX - d) : (c >= INT16_MIN - d)) {
+      Counts[k] = c + d;
+    }
+    State[k] = ab;
+  }
+}
+
+void Setup() {
+  uint8_t enabled = 0;
+  uint8_t mask = 0;
+#ifdef USE_MOUSE
+  for (uint8_t k = 0; k < NB_ENCODERS; k++) {
+    auto &encDB = Config::ConfigFile.Encoders[k];
+    // Mouse axis W/Y/X bits
+    if ((encDB.MapTo & 0b111) == 0)
+      continue;
+    enabled |= 1 << k;
+    mask |= _BV(PinA[k]) | _BV(PinB[k]);
+    // Up to 127/16 per edge
+    Scale[k] = (encDB.Scale == 0) ? DEFAULT_ENCODER_SCALE : ((encDB.Scale > 127) ? 127 : encDB.Scale);
+  }
+#endif
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    // Inputs with pull-up
+    DDRB &= ~mask;
+    PORTB |= mask;
+    uint8_t pins = PINB;
+    for (uint8_t k = 0; k < NB_ENCODERS; k++) {
+      State[k] = ReadAB(pins, k);
+      Counts[k] = 0;
+    }
+    Enabled = enabled;
+    PCMSK0 = mask;
+    if (mask != 0) {
+      PCIFR = _BV(PCIF0);
+      PCICR |= _BV(PCIE0);
+    } else {
+      PCICR &= ~_BV(PCIE0);
+    }
+  }
+}
+
+// MCU digital inputs (bit i for MCU input i) used by encoders
+uint8_t UsedDInMask() {
+  uint8_t mask = 0;
+  for (uint8_t k = 0; k < NB_ENCODERS; k++) {
+    if (Enabled & (1 << k)) {
+      mask |= DInMask[k];
+    }
+  }
+  return mask;
+}
+
+// Analog output used by an encoder
+bool UsedAOut(uint8_t aout) {
+  for (uint8_t k = 0; k < NB_ENCODERS; k++) {
+    if ((Enabled & (1 << k)) && (AOutMask[k] & (1 << aout)))
+      return true;
+  }
+  return false;
+}
+
+// Take whole counts of an encoder, fractions kept for next time
+int16_t Drain(uint8_t enc) {
+  if (!(Enabled & (1 << enc)))
+    return 0;
+  int16_t move;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    move = Counts[enc] / 16;
+    Counts[enc] -= move * 16;
+  }
+  return move;
+}
+
+}
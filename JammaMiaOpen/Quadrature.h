@@ -0,0 +1,14 @@
+/*
+  Quadrature encoders (spinners, trackballs) on MCU pin change interrupt pins
+*/
+#pragma once
+#include "Config.h"
+
+namespace Quadrature {
+
+void Setup();
+uint8_t UsedDInMask();
+bool UsedAOut(uint8_t aout);
+int16_t Drain(uint8_t enc);
+
+}
@@ -0,0 +1,184 @@
+/*
+  Ramps
+
+  A ramp moves a joy axis, or a mouse axis velocity, toward its end while
+  its inputs are held and back to rest when released, with attack and
+  decay rates from the input config. Levels are integrated by the tick
+  interrupt so the ramp does not depend on the loop time. The main loop
+  sums the ramps of each joy axis and sends the axis when it changed, and
+  sends the mouse moves accumulated since last loop.
+
+  A ramp is identified by its mapping value: inputs sharing the mapping
+  share the ramp, with the rates of the first configured input.
+*/
+#include "Ramp.h"
+#include "Tick.h"
+#include <util/atomic.h>
+
+#ifdef USE_JOY
+#include "Joy.h"
+#endif
+#ifdef USE_MOUSE
+#include "Mou.h"
+#endif
+
+namespace Ramp {
+
+#define MAX_RAMPS (8)
+// Levels are Q4 values of the axis travel
+#define HALF_SPAN ((uint16_t)AIN_CENTERED_VAL << 4)
+#define FULL_SPAN ((uint16_t)AIN_MAX_VAL << 4)
+// Joy axis of a ramp: player and axis index
+#define RAMP_AXIS(m) ((m) & 0x87)
+
+static uint8_t NbRamps = 0;
+static byte Mappings[MAX_RAMPS];
+// Q4 steps per tick and maximum level
+static uint16_t Attack[MAX_RAMPS];
+static uint16_t Decay[MAX_RAMPS];
+static uint16_t Span[MAX_RAMPS];
+// ISR state: levels and mouse moves (Q16 counts), bit k of held mask for ramp k
+static volatile uint16_t Level[MAX_RAMPS];
+static volatile uint32_t MouseAccu[MAX_RAMPS];
+static volatile uint8_t HeldMask = 0;
+// Last sent value of joy axes, for the first ramp of each axis
+static int16_t LastValue[MAX_RAMPS];
+
+static void Add(byte mapping, byte rates) {
+  for (uint8_t k = 0; k < NbRamps; k++) {
+    if (Mappings[k] == mapping)
+      return;
+  }
+  if (NbRamps >= MAX_RAMPS)
+    return;
+  uint8_t k = NbRamps;
+  if (rates == 0) {
+    rates = DEFAULT_RAMP;
+  }
+  Mappings[k] = mapping;
+  // Mouse ramps go up to about one count per tick
+  Span[k] = (mapping & (Config::RampOptions::RampFullTravel | Config::RampOptions::RampMouse)) ? FULL_SPAN : HALF_SPAN;
+  // Full scale in (n+1)*64 ticks
+  Attack[k] = Span[k] / (((rates >> 4) + 1) * 64);
+  Decay[k] = Span[k] / (((rates & 0x0F) + 1) * 64);
+  Level[k] = 0;
+  MouseAccu[k] = 0;
+  LastValue[k] = -1;
+  NbRamps++;
+}
+
+void Setup() {
+  // Stop the ISR from using the tables while they are rebuilt
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    NbRamps = 0;
+    HeldMask = 0;
+  }
+  // A ramp is only seen by the ISR once filled
+  for (uint8_t i = 0; i < NB_DIGITALINPUTS; i++) {
+    auto &dinDB = Config::ConfigFile.DigitalInB[i];
+    if (dinDB.Type != Config::MappingType::Ramp)
+      continue;
+    Add(dinDB.MapTo, dinDB.Turbo);
+    for (uint8_t l = 0; l < NB_LAYERS - 1; l++) {
+      if (dinDB.MapToLayer[l] != 0) {
+        Add(dinDB.MapToLayer[l], dinDB.Turbo);
+      }
+    }
+  }
+  for (uint8_t k = 0; k < NB_FANOUTS; k++) {
+    auto &fanDB = Config::ConfigFile.FanOuts[k];
+    if ((fanDB.DIn != 0) && (fanDB.Type == Config::MappingType::Ramp)) {
+      Add(fanDB.MapTo, 0);
+    }
+  }
+}
+
+void Hold(byte mapping, bool state) {
+  for (uint8_t k = 0; k < NbRamps; k++) {
+    if (Mappings[k] == mapping) {
+      ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (state) {
+          HeldMask |= (1 << k);
+        } else {
+          HeldMask &= ~(1 << k);
+        }
+      }
+      return;
+    }
+  }
+}
+
+// Called by the tick interrupt
+void OnTick() {
+  uint8_t held = HeldMask;
+  for (uint8_t k = 0; k < NbRamps; k++, held >>= 1) {
+    uint16_t level = Level[k];
+    if (held & 1) {
+      level = (Span[k] - level > Attack[k]) ? level + Attack[k] : Span[k];
+    } else {
+      level = (level > Decay[k]) ? level - Decay[k] : 0;
+    }
+    Level[k] = level;
+    if (Mappings[k] & Config::RampOptions::RampMouse) {
+      MouseAccu[k] += level;
+    }
+  }
+}
+
+// Send ramped axes from main loop
+void Run() {
+  for (uint8_t k = 0; k < NbRamps; k++) {
+    byte mapping = Mappings[k];
+    if (mapping & Config::RampOptions::RampMouse) {
+#ifdef USE_MOUSE
+      // About one count per tick at full level
+      uint32_t accu;
+      ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        accu = MouseAccu[k];
+        MouseAccu[k] = accu & 0xFFFF;
+      }
+      uint16_t counts = accu >> 16;
+      if (counts > 0) {
+        // Sign from the negative option, as for a mouse axis
+        Mou::MoveAxis(mapping & 0x8F, counts);
+      }
+#endif
+      continue;
+    }
+#ifdef USE_JOY
+    // Sum all ramps of the axis, on its first ramp
+    bool first = true;
+    for (uint8_t j = 0; j < k; j++) {
+      if (!(Mappings[j] & Config::RampOptions::RampMouse) && (RAMP_AXIS(Mappings[j]) == RAMP_AXIS(mapping))) {
+        first = false;
+        break;
+      }
+    }
+    if (!first)
+      continue;
+    int16_t value = AIN_CENTERED_VAL;
+    for (uint8_t j = k; j < NbRamps; j++) {
+      byte m = Mappings[j];
+      if ((m & Config::RampOptions::RampMouse) || (RAMP_AXIS(m) != RAMP_AXIS(mapping)))
+        continue;
+      uint16_t level;
+      ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        level = Level[j];
+      }
+      int16_t move = level >> 4;
+      if (m & Config::RampOptions::RampFullTravel) {
+        // Rest at the opposite end
+        move -= AIN_CENTERED_VAL;
+      }
+      value += (m & Config::RampOptions::RampNegative) ? -move : move;
+    }
+    value = constrain(value, JOY_MAXNEG_VAL, JOY_MAXPOS_VAL);
+    if (value != LastValue[k]) {
+      LastValue[k] = value;
+      Joy::SetAxis(RAMP_AXIS(mapping), value);
+    }
+#endif
+  }
+}
+
+}
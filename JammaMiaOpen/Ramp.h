@@ -0,0 +1,14 @@
+/*
+  Axes ramped by digital inputs, driven by the hardware tick
+*/
+#pragma once
+#include "Config.h"
+
+namespace Ramp {
+
+void Setup();
+void Hold(byte mapping, bool state);
+void Run();
+void OnTick();
+
+}
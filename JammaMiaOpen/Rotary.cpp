@@ -0,0 +1,164 @@
+/*
+  Rotary joysticks
+
+  SNK-style rotary sticks give their position on a group of contacts,
+  either gray coded (4 inputs for 12 positions, 5 for 24) or one contact
+  per position. The group is taken out of the packed inputs word with a
+  shift and a mask, and only decoded when it changed: gray codes through
+  a table built at setup, one-hot codes through a nibble table. Codes
+  between two contacts, or out of range, keep the last position.
+
+  Inputs of a group are not reported on their own. The position is sent
+  as an absolute joy axis, or as clockwise/counter-clockwise pulses, one
+  press or release per loop so that each step is seen by the host.
+*/
+#include "Rotary.h"
+#include "Mapping.h"
+
+#ifdef USE_JOY
+#include "Joy.h"
+#endif
+
+namespace Rotary {
+
+#define NO_POSITION (0xFF)
+#define MAX_GRAY_INPUTS (5)
+#define MAX_ONEHOT_INPUTS (12)
+
+// Bit index of one-hot nibbles
+static const uint8_t NibbleBit[16] = {
+  NO_POSITION, 0, 1, NO_POSITION, 2, NO_POSITION, NO_POSITION, NO_POSITION,
+  3, NO_POSITION, NO_POSITION, NO_POSITION, NO_POSITION, NO_POSITION, NO_POSITION, NO_POSITION
+};
+
+static uint8_t NbRotaries = 0;
+static uint8_t Indexes[NB_ROTARIES];
+static uint8_t Shift[NB_ROTARIES];
+static uint16_t Mask[NB_ROTARIES];
+// Position of each gray code
+static uint8_t GrayTable[NB_ROTARIES][1 << MAX_GRAY_INPUTS];
+// Inputs of all groups
+static uint32_t GroupsMask = 0;
+// Runtime state
+static uint16_t LastCode[NB_ROTARIES];
+static uint8_t Position[NB_ROTARIES];
+static uint8_t LastSent[NB_ROTARIES];
+// Steps to send, positive clockwise
+static int8_t Pending[NB_ROTARIES];
+// Step target pressed, bit k for rotary k, its direction being in LastSent
+static uint8_t PulseHeld = 0;
+
+static uint8_t DecodeOneHot(uint16_t code) {
+  for (uint8_t n = 0; n < MAX_ONEHOT_INPUTS; n += 4, code >>= 4) {
+    if (code & 0x0F) {
+      uint8_t bit = NibbleBit[code & 0x0F];
+      // Only one contact allowed
+      return ((bit != NO_POSITION) && ((code >> 4) == 0)) ? n + bit : NO_POSITION;
+    }
+  }
+  return NO_POSITION;
+}
+
+// Step targets still pressed are released when the mapping is compiled
+void Setup() {
+  PulseHeld = 0;
+  uint8_t nb = 0;
+  uint32_t groups = 0;
+  for (uint8_t i = 0; i < NB_ROTARIES; i++) {
+    auto &rotDB = Config::ConfigFile.Rotaries[i];
+    uint8_t n = rotDB.Options & Config::RotaryOptions::RotaryInputsMask;
+    bool onehot = rotDB.Options & Config::RotaryOptions::RotaryOneHot;
+    if ((rotDB.DIn == 0) || (n < 2) || (n > (onehot ? MAX_ONEHOT_INPUTS : MAX_GRAY_INPUTS)) ||
+        (rotDB.DIn - 1 + n > NB_DIGITALINPUTS) || (rotDB.Positions < 2))
+      continue;
+    Indexes[nb] = i;
+    Shift[nb] = rotDB.DIn - 1;
+    Mask[nb] = (1 << n) - 1;
+    if (!onehot) {
+      // Cyclic subset of the gray sequence: first half and last half of
+      // the positions, so that last to first position also changes 1 bit
+      uint8_t codes = 1 << n;
+      uint8_t half = (rotDB.Positions + 1) >> 1;
+      uint8_t gap = (rotDB.Positions < codes) ? codes - rotDB.Positions : 0;
+      for (uint8_t code = 0; code < codes; code++) {
+        // Gray to binary
+        uint8_t b = code;
+        for (uint8_t s = code >> 1; s != 0; s >>= 1) {
+          b ^= s;
+        }
+        uint8_t pos = NO_POSITION;
+        if (b < half) {
+          pos = b;
+        } else if (b >= half + gap) {
+          pos = b - gap;
+        }
+        GrayTable[nb][code] = pos;
+      }
+    }
+    LastCode[nb] = 0xFFFF;
+    Position[nb] = NO_POSITION;
+    LastSent[nb] = NO_POSITION;
+    Pending[nb] = 0;
+    groups |= (uint32_t)Mask[nb] << Shift[nb];
+    nb++;
+  }
+  NbRotaries = nb;
+  GroupsMask = groups;
+}
+
+// Decode groups that changed, and take their inputs out
+uint32_t Apply(uint32_t din) {
+  for (uint8_t k = 0; k < NbRotaries; k++) {
+    uint16_t code = (din >> Shift[k]) & Mask[k];
+    if (code == LastCode[k])
+      continue;
+    LastCode[k] = code;
+    auto &rotDB = Config::ConfigFile.Rotaries[Indexes[k]];
+    uint8_t pos = (rotDB.Options & Config::RotaryOptions::RotaryOneHot) ? DecodeOneHot(code) : GrayTable[k][code];
+    if ((pos == NO_POSITION) || (pos >= rotDB.Positions))
+      continue;
+    if ((Position[k] != NO_POSITION) && (rotDB.Options & Config::RotaryOptions::RotarySteps)) {
+      // Shortest way around
+      int8_t delta = pos - Position[k];
+      int8_t half = rotDB.Positions >> 1;
+      if (delta > half) {
+        delta -= rotDB.Positions;
+      } else if (delta < -half) {
+        delta += rotDB.Positions;
+      }
+      Pending[k] = constrain(Pending[k] + delta, -100, 100);
+    }
+    Position[k] = pos;
+  }
+  return din & ~GroupsMask;
+}
+
+// Send positions or step pulses
+void Run() {
+  for (uint8_t k = 0; k < NbRotaries; k++) {
+    auto &rotDB = Config::ConfigFile.Rotaries[Indexes[k]];
+    if (rotDB.Options & Config::RotaryOptions::RotarySteps) {
+      uint8_t bit = 1 << k;
+      if (PulseHeld & bit) {
+        // Release in the direction of the step
+        Mapping::Inject(rotDB.Type, (LastSent[k] != 0) ? rotDB.MapTo : rotDB.MapToCCW, false);
+        PulseHeld &= ~bit;
+      } else if (Pending[k] != 0) {
+        bool cw = Pending[k] > 0;
+        Pending[k] += cw ? -1 : 1;
+        LastSent[k] = cw;
+        Mapping::Inject(rotDB.Type, cw ? rotDB.MapTo : rotDB.MapToCCW, true);
+        PulseHeld |= bit;
+      }
+      continue;
+    }
+#ifdef USE_JOY
+    if ((Position[k] != NO_POSITION) && (Position[k] != LastSent[k])) {
+      LastSent[k] = Position[k];
+      Joy::SetAxis(rotDB.MapTo, ((uint32_t)Position[k] * AIN_MAX_VAL) / (rotDB.Positions - 1));
+    }
+#endif
+  }
+}
+
+}
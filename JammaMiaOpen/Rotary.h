@@ -0,0 +1,13 @@
+/*
+  Rotary joysticks: groups of digital inputs decoded into a position
+*/
+#pragma once
+#include "Config.h"
+
+namespace Rotary {
+
+void Setup();
+uint32_t Apply(uint32_t din);
+void Run();
+
+}
@@ -0,0 +1,98 @@
+/*
+  SOCD cleaning
+
+  Each SOCD group gives the Up/Down/Left/Right digital inputs of a stick
+  and a policy for opposite directions held together. Both pairs of a
+  group are resolved on the packed inputs word, right after debouncing and
+  before the inputs are mapped, so that the cleaned state goes out in the
+  same loop as the edge, whatever the mapping (HAT, keys, buttons).
+*/
+#include "Socd.h"
+
+namespace Socd {
+
+#define NB_PAIRS (NB_SOCD_GROUPS * 2)
+
+typedef struct {
+  // First (Up or Left) and second (Down or Right) direction
+  uint32_t A;
+  uint32_t B;
+  Config::SOCDPolicies Policy;
+  // A has priority for UpPriority policy (vertical pair)
+  bool Vertical;
+} Pair;
+
+static Pair Pairs[NB_PAIRS];
+static uint8_t NbPairs = 0;
+// Raw inputs at last loop, to detect last pressed direction
+static uint32_t LastDIn = 0;
+// Last pressed direction of each pair is A, bit k for pair k
+static uint8_t LastIsA = 0;
+
+static uint32_t InputMask(uint8_t din) {
+  // Input index +1, 0 for none
+  return ((din > 0) && (din <= NB_DIGITALINPUTS)) ? (uint32_t)1 << (din - 1) : 0;
+}
+
+void Setup() {
+  uint8_t nb = 0;
+  for (uint8_t g = 0; g < NB_SOCD_GROUPS; g++) {
+    auto &group = Config::ConfigFile.SOCDGroups[g];
+    if (group.Policy == Config::SOCDPolicies::Off)
+      continue;
+    for (uint8_t v = 0; v < 2; v++) {
+      Pair &p = Pairs[nb];
+      p.A = InputMask(v ? group.Up : group.Left);
+      p.B = InputMask(v ? group.Down : group.Right);
+      p.Policy = group.Policy;
+      p.Vertical = v;
+      if ((p.A != 0) && (p.B != 0)) {
+        nb++;
+      }
+    }
+  }
+  NbPairs = nb;
+  LastIsA = 0;
+}
+
+uint32_t Resolve(uint32_t din) {
+  uint32_t pressed = din & ~LastDIn;
+  LastDIn = din;
+  for (uint8_t k = 0; k < NbPairs; k++) {
+    const Pair &p = Pairs[k];
+    uint8_t bit = 1 << k;
+    // Track last pressed direction
+    if ((pressed & p.A) && !(pressed & p.B)) {
+      LastIsA |= bit;
+    } else if ((pressed & p.B) && !(pressed & p.A)) {
+      LastIsA &= ~bit;
+    }
+    if (!(din & p.A) || !(din & p.B))
+      continue;
+    // Both directions held
+    switch (p.Policy) {
+      case Config::SOCDPolicies::LastWins:
+        if ((pressed & p.A) && (pressed & p.B)) {
+          // Pressed in the same loop: neutral
+          din &= ~(p.A | p.B);
+        } else {
+          din &= ~((LastIsA & bit) ? p.B : p.A);
+        }
+        break;
+      case Config::SOCDPolicies::UpPriority:
+        if (p.Vertical) {
+          din &= ~p.B;
+          break;
+        }
+        // Left+Right: neutral
+        din &= ~(p.A | p.B);
+        break;
+      default:
+        din &= ~(p.A | p.B);
+        break;
+    }
+  }
+  return din;
+}
+
+}
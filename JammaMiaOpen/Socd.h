@@ -0,0 +1,12 @@
+/*
+  SOCD (simultaneous opposite cardinal directions) cleaning of digital directions
+*/
+#pragma once
+#include "Config.h"
+
+namespace Socd {
+
+void Setup();
+uint32_t Resolve(uint32_t din);
+
+}
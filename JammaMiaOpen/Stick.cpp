@@ -0,0 +1,144 @@
+/*
+  Paired analog inputs processed as a 2D stick
+
+  An even analog input with the Paired option is the X axis of a stick, the
+  next input being its Y axis. The stick leaves its center when it goes out
+  of a circle (instead of the square given by two separate dead zones), then
+  its angle selects one of 8 octants (or 4 quadrants), giving the -1/0/+1
+  zone of each axis. Both the radius and the sector boundaries have some
+  hysteresis so that a stick resting on a limit does not toggle.
+
+  The angle is a 12-bit binary angle (4096 per turn) from a fixed-point
+  atan2: octant folding and an interpolated table of atan over 0..45 deg.
+*/
+#include "Stick.h"
+
+namespace Stick {
+
+#define NB_PAIRS (NB_ANALOGINPUTS / 2)
+#define ANGLE_TURN (4096)
+// Hysteresis of sector boundaries, ~5.6 deg
+#define ANGLE_HYSTERESIS (ANGLE_TURN / 64)
+
+// atan(k/16) for k=0..16, in 1/4096 turn
+static const uint16_t AtanTable[17] PROGMEM = {
+  0, 41, 81, 121, 160, 197, 234, 269, 302, 334, 364, 393, 419, 445, 469, 491, 512
+};
+
+static uint8_t PairedMask = 0;
+// Squared radius to leave/come back to the center
+static uint32_t EnterRadius2[NB_PAIRS];
+static uint32_t LeaveRadius2[NB_PAIRS];
+// Number of sectors: 8 (octants) or 4 (quadrants)
+static uint8_t NbSectors[NB_PAIRS];
+// Current state: sector + 1, 0 when centered
+static uint8_t Sector[NB_PAIRS];
+
+// Axis zones of each sector, sector 0 being centered on +X and turning toward +Y
+static const int8_t OctantZones[8][2] = {
+  { 1, 0 }, { 1, 1 }, { 0, 1 }, { -1, 1 }, { -1, 0 }, { -1, -1 }, { 0, -1 }, { 1, -1 }
+};
+
+void Setup() {
+  PairedMask = 0;
+  for (uint8_t p = 0; p < NB_PAIRS; p++) {
+    auto &xDB = Config::ConfigFile.AnalogInDB[2 * p];
+    Sector[p] = 0;
+    if (!(xDB.Options & Config::AInOptions::Paired))
+      continue;
+    PairedMask |= 0b11 << (2 * p);
+    // Radius from dead zone of X input
+    int32_t radius = (((int32_t)xDB.DeadzoneMax - (int32_t)xDB.DeadzoneMin) << (AIN_BITS - 8)) / 2;
+    int32_t enter = radius + xDB.Hysteresis;
+    int32_t leave = radius - xDB.Hysteresis;
+    if (leave < 0) {
+      leave = 0;
+    }
+    EnterRadius2[p] = enter * enter;
+    LeaveRadius2[p] = leave * leave;
+    NbSectors[p] = (xDB.Options & Config::AInOptions::Quadrant) ? 4 : 8;
+  }
+}
+
+// Input is X or Y of a stick
+bool IsPaired(uint8_t ain) {
+  return PairedMask & (1 << ain);
+}
+
+static uint16_t Angle(int16_t dx, int16_t dy) {
+  uint16_t ax = (dx < 0) ? -dx : dx;
+  uint16_t ay = (dy < 0) ? -dy : dy;
+  bool swapped = ay > ax;
+  if (swapped) {
+    uint16_t t = ax;
+    ax = ay;
+    ay = t;
+  }
+  if (ax == 0)
+    return 0;
+  // Fold to 0..45 deg: ratio in Q8
+  uint16_t ratio = ((uint32_t)ay << 8) / ax;
+  uint8_t idx = ratio >> 4;
+  uint16_t a;
+  if (idx >= 16) {
+    a = pgm_read_word(&AtanTable[16]);
+  } else {
+    uint16_t a0 = pgm_read_word(&AtanTable[idx]);
+    uint16_t a1 = pgm_read_word(&AtanTable[idx + 1]);
+    a = a0 + (((a1 - a0) * (ratio & 0x0F)) >> 4);
+  }
+  // Unfold to octant, then quadrant
+  if (swapped) {
+    a = ANGLE_TURN / 4 - a;
+  }
+  if (dx < 0) {
+    a = ANGLE_TURN / 2 - a;
+  }
+  if (dy < 0) {
+    a = ANGLE_TURN - a;
+  }
+  return a & (ANGLE_TURN - 1);
+}
+
+// Process a stick, gives zone -1/0/+1 of X and Y
+void Update(uint8_t pair, int16_t x, int16_t y, int8_t zones[2]) {
+  int16_t dx = x - AIN_CENTERED_VAL;
+  int16_t dy = y - AIN_CENTERED_VAL;
+  uint32_t r2 = (int32_t)dx * dx + (int32_t)dy * dy;
+  uint8_t sector = Sector[pair];
+
+  if ((sector == 0) ? (r2 <= EnterRadius2[pair]) : (r2 < LeaveRadius2[pair])) {
+    // Centered
+    Sector[pair] = 0;
+    zones[0] = 0;
+    zones[1] = 0;
+    return;
+  }
+
+  uint8_t nb = NbSectors[pair];
+  uint16_t width = ANGLE_TURN / nb;
+  uint16_t angle = Angle(dx, dy);
+  if (sector != 0) {
+    // Keep current sector while within its boundaries plus hysteresis
+    int16_t diff = (angle - (sector - 1) * width) & (ANGLE_TURN - 1);
+    if (diff >= ANGLE_TURN / 2) {
+      diff -= ANGLE_TURN;
+    }
+    if (diff < 0) {
+      diff = -diff;
+    }
+    if (diff > (int16_t)(width / 2 + ANGLE_HYSTERESIS)) {
+      sector = 0;
+    }
+  }
+  if (sector == 0) {
+    sector = (((angle + width / 2) & (ANGLE_TURN - 1)) / width) + 1;
+    Sector[pair] = sector;
+  }
+  // Quadrants are the even octants
+  const int8_t *z = OctantZones[(sector - 1) * (8 / nb)];
+  zones[0] = z[0];
+  zones[1] = z[1];
+}
+
+}
@@ -0,0 +1,13 @@
+/*
+  Paired analog inputs processed as a 2D stick: radial dead zone and angular gate
+*/
+#pragma once
+#include "Config.h"
+
+namespace Stick {
+
+void Setup();
+bool IsPaired(uint8_t ain);
+void Update(uint8_t pair, int16_t x, int16_t y, int8_t zones[2]);
+
+}
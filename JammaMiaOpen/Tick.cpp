@@ -0,0 +1,39 @@
+/*
+  1kHz hardware tick
+
+  Timer0 is already running for millis(), with a 64 prescaler and its
+  overflow interrupt used by the Arduino core. Its compare A interrupt is
+  free: with OCR0A in the middle of the count it fires once per overflow
+  period, half a period away from the core interrupt. Timer1/3/4 are left
+  for the PWM outputs.
+*/
+#include "Tick.h"
+#include "Turbo.h"
+#include "Ramp.h"
+#include <util/atomic.h>
+
+namespace Tick {
+
+static volatile uint16_t Ticks = 0;
+
+ISR(TIMER0_COMPA_vect) {
+  Ticks++;
+  Turbo::OnTick();
+  Ramp::OnTick();
+}
+
+void Setup() {
+  OCR0A = 0x80;
+  TIMSK0 |= _BV(OCIE0A);
+}
+
+// Number of ticks since setup, wrapping
+uint16_t Now() {
+  uint16_t now;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    now = Ticks;
+  }
+  return now;
+}
+
+}
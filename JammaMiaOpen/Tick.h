@@ -0,0 +1,16 @@
+/*
+  1kHz hardware tick from Timer0 compare A, for time-driven features
+*/
+#pragma once
+#include "Config.h"
+
+// Timer0 overflows every 64*256 cycles at 16MHz
+#define HWTICK_US (1024)
+#define HWTICK_HZ (1000000UL / HWTICK_US)
+
+namespace Tick {
+
+void Setup();
+uint16_t Now();
+
+}
@@ -0,0 +1,105 @@
+/*
+  Autofire of digital inputs
+
+  Each autofire input has a period and an on-time in units of 2 ticks,
+  so that they fit in a byte up to the 2Hz rate (500 ticks). The tick
+  interrupt runs a counter per input and toggles its bit in the phase
+  word at exact tick boundaries, so the rate does not depend on the loop
+  time. The main loop masks the held autofire inputs with the phase word:
+  all toggles that happened since last loop are reported in the same HID
+  report. A new press restarts the counter of the input, so that it fires
+  at once.
+*/
+#include "Turbo.h"
+#include "Tick.h"
+#include <util/atomic.h>
+
+namespace Turbo {
+
+// Autofire inputs
+#define MAX_AUTOFIRE (8)
+static uint32_t Mask = 0;
+static uint8_t NbInputs = 0;
+static uint8_t Inputs[MAX_AUTOFIRE];
+// Period and on-time in units of 2 ticks of each autofire input
+static uint8_t Period[MAX_AUTOFIRE];
+static uint8_t OnTicks[MAX_AUTOFIRE];
+// ISR state: counters in ticks and phase word (bit set while the input fires)
+static uint16_t Counter[MAX_AUTOFIRE];
+static volatile uint32_t Phase = 0;
+// Held autofire inputs at last loop
+static uint32_t LastHeld = 0;
+
+void Setup() {
+  uint32_t mask = 0;
+  uint8_t nb = 0;
+  // Stop the ISR from using the tables while they are rebuilt
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    NbInputs = 0;
+  }
+  for (uint8_t i = 0; (i < NB_DIGITALINPUTS) && (nb < MAX_AUTOFIRE); i++) {
+    auto &dinDB = Config::ConfigFile.DigitalInB[i];
+    if (!(dinDB.Options & Config::DInOptions::AutoFire))
+      continue;
+    byte turbo = (dinDB.Turbo != 0) ? dinDB.Turbo : DEFAULT_TURBO;
+    // Rate is 2..32Hz, on-time is 1/16..16/16 of the period
+    uint16_t hz = ((turbo >> 4) + 1) * 2;
+    uint16_t period = HWTICK_HZ / hz;
+    uint16_t on = (period * ((turbo & 0x0F) + 1)) >> 4;
+    // Round to 2 ticks, on-time at least 2 ticks
+    Period[nb] = (period + 1) >> 1;
+    OnTicks[nb] = (on > 1) ? ((on + 1) >> 1) : 1;
+    Counter[nb] = 0;
+    Inputs[nb] = i;
+    nb++;
+    mask |= (uint32_t)1 << i;
+  }
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    NbInputs = nb;
+    Phase = mask;
+  }
+  Mask = mask;
+  LastHeld = 0;
+}
+
+// Mask held autofire inputs with their phase
+uint32_t Apply(uint32_t din) {
+  if (Mask == 0)
+    return din;
+  uint32_t held = din & Mask;
+  uint32_t pressed = held & ~LastHeld;
+  LastHeld = held;
+  uint32_t phase;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    if (pressed) {
+      // Restart counters of new presses: fire at once
+      for (uint8_t k = 0; k < NbInputs; k++) {
+        if (pressed & ((uint32_t)1 << Inputs[k])) {
+          Counter[k] = 0;
+        }
+      }
+      Phase |= pressed;
+    }
+    phase = Phase;
+  }
+  return din & (~Mask | phase);
+}
+
+// Called from the tick interrupt
+void OnTick() {
+  uint32_t phase = Phase;
+  for (uint8_t k = 0; k < NbInputs; k++) {
+    uint16_t c = Counter[k] + 1;
+    uint32_t bit = (uint32_t)1 << Inputs[k];
+    if (c >= ((uint16_t)Period[k] << 1)) {
+      c = 0;
+      phase |= bit;
+    } else if (c == ((uint16_t)OnTicks[k] << 1)) {
+      phase &= ~bit;
+    }
+    Counter[k] = c;
+  }
+  Phase = phase;
+}
+
+}
@@ -0,0 +1,13 @@
+/*
+  Autofire of digital inputs, driven by the hardware tick
+*/
+#pragma once
+#include "Config.h"
+
+namespace Turbo {
+
+void Setup();
+uint32_t Apply(uint32_t din);
+void OnTick();
+
+}
@@ -0,0 +1,147 @@
+/*
+  AbsMouseN.cpp
+
+  Copyright (c) 2015, Arduino LLC
+  Original code (pre-library): Copyright (c) 2011, Peter Barrett
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "AbsMouseN.h"
+
+#if defined(_USING_HID)
+
+static const uint8_t _hidReportDescriptorAbsMouse1[] PROGMEM = {
+  
+  //  Absolute mouse
+    0x05, 0x01,                    // USAGE_PAGE (Generic Desktop)
+    0x09, 0x02,                    // USAGE (Mouse)
+    0xa1, 0x01,                    // COLLECTION (Application)
+    0x09, 0x01,                    //   USAGE (Pointer)
+    0xa1, 0x00,                    //   COLLECTION (Physical)
+    0x85, 0x06,                    //     REPORT_ID (6)
+    0x05, 0x09,                    //     USAGE_PAGE (Button)
+    0x19, 0x01,                    //     USAGE_MINIMUM (Button 1)
+    0x29, 0x05,                    //     USAGE_MAXIMUM (Button 5)
+    0x15, 0x00,                    //     LOGICAL_MINIMUM (0)
+    0x25, 0x01,                    //     LOGICAL_MAXIMUM (1)
+    0x95, 0x05,                    //     REPORT_COUNT (5)
+    0x75, 0x01,                    //     REPORT_SIZE (1)
+    0x81, 0x02,                    //     INPUT (Data,Var,Abs)
+    0x95, 0x01,                    //     REPORT_COUNT (1)
+    0x75, 0x03,                    //     REPORT_SIZE (3)
+    0x81, 0x03,                    //     INPUT (Cnst,Var,Abs)
+    0x05, 0x01,                    //     USAGE_PAGE (Generic Desktop)
+    0x09, 0x30,                    //     USAGE (X)
+    0x09, 0x31,                    //     USAGE (Y)
+    0x15, 0x00,                    //     LOGICAL_MINIMUM (0)
+    0x26, 0xff, 0x7f,              //     LOGICAL_MAXIMUM (32767)
+    0x75, 0x10,                    //     REPORT_SIZE (16)
+    0x95, 0x02,                    //     REPORT_COUNT (2)
+    0x81, 0x02,                    //     INPUT (Data,Var,Abs)
+    0xc0,                          //   END_COLLECTION
+    0xc0,                          // END_COLLECTION
+};
+
+static const uint8_t _hidReportDescriptorAbsMouse2[] PROGMEM = {
+  
+  //  Absolute mouse
+    0x05, 0x01,                    // USAGE_PAGE (Generic Desktop)
+    0x09, 0x02,                    // USAGE (Mouse)
+    0xa1, 0x01,                    // COLLECTION (Application)
+    0x09, 0x01,                    //   USAGE (Pointer)
+    0xa1, 0x00,                    //   COLLECTION (Physical)
+    0x85, 0x07,                    //     REPORT_ID (7)
+    0x05, 0x09,                    //     USAGE_PAGE (Button)
+    0x19, 0x01,                    //     USAGE_MINIMUM (Button 1)
+    0x29, 0x05,                    //     USAGE_MAXIMUM (Button 5)
+    0x15, 0x00,                    //     LOGICAL_MINIMUM (0)
+    0x25, 0x01,                    //     LOGICAL_MAXIMUM (1)
+    0x95, 0x05,                    //     REPORT_COUNT (5)
+    0x75, 0x01,                    //     REPORT_SIZE (1)
+    0x81, 0x02,                    //     INPUT (Data,Var,Abs)
+    0x95, 0x01,                    //     REPORT_COUNT (1)
+    0x75, 0x03,                    //     REPORT_SIZE (3)
+    0x81, 0x03,                    //     INPUT (Cnst,Var,Abs)
+    0x05, 0x01,                    //     USAGE_PAGE (Generic Desktop)
+    0x09, 0x30,                    //     USAGE (X)
+    0x09, 0x31,                    //     USAGE (Y)
+    0x15, 0x00,                    //     LOGICAL_MINIMUM (0)
+    0x26, 0xff, 0x7f,              //     LOGICAL_MAXIMUM (32767)
+    0x75, 0x10,                    //     REPORT_SIZE (16)
+    0x95, 0x02,                    //     REPORT_COUNT (2)
+    0x81, 0x02,                    //     INPUT (Data,Var,Abs)
+    0xc0,                          //   END_COLLECTION
+    0xc0,                          // END_COLLECTION
+};
+
+//================================================================================
+//================================================================================
+//	Absolute mouse
+
+AbsMouseN_::AbsMouseN_(bool isDual)
+{
+	_isDual = isDual;
+    static HIDSubDescriptor node(_hidReportDescriptorAbsMouse1, sizeof(_hidReportDescriptorAbsMouse1));
+    HID().AppendDescriptor(&node);
+	if (_isDual) {
+		static HIDSubDescriptor node(_hidReportDescriptorAbsMouse2, sizeof(_hidReportDescriptorAbsMouse2));
+		HID().AppendDescriptor(&node);
+	}
+}
+
+void AbsMouseN_::begin(void) 
+{
+	memset(_mouseReports, 0, sizeof(_mouseReports));
+}
+
+void AbsMouseN_::end(void) 
+{
+}
+
+void AbsMouseN_::moveTo(uint16_t x, uint16_t y, bool dual)
+{
+	int index = dual?1:0;
+	_mouseReports[index].x = (x > ABSMOUSE_MAX) ? ABSMOUSE_MAX : x;
+	_mouseReports[index].y = (y > ABSMOUSE_MAX) ? ABSMOUSE_MAX : y;
+}
+
+void AbsMouseN_::press(uint8_t b, bool dual) 
+{
+	int index = dual?1:0;
+	_mouseReports[index].buttons |= b;
+}
+
+void AbsMouseN_::release(uint8_t b, bool dual)
+{
+	int index = dual?1:0;
+	_mouseReports[index].buttons &= ~b;
+}
+
+bool AbsMouseN_::isPressed(uint8_t b, bool dual)
+{
+	int index = dual?1:0;
+	if ((b & _mouseReports[index].buttons) > 0) 
+		return true;
+	return false;
+}
+
+void AbsMouseN_::sendReport(bool dual)
+{
+	int report = dual?7:6;
+	HID().SendReport(report, &_mouseReports[dual?1:0], sizeof(AbsMouseReport));
+}
+  
+#endif
@@ -41,12 +41,24 @@
 #define MOUSE_NEXT 16
 #define MOUSE_ALL (MOUSE_LEFT | MOUSE_RIGHT | MOUSE_MIDDLE | MOUSE_PREV | MOUSE_NEXT)
 
+// 16-bit X/Y moves in reports, comment out for 8-bit moves (-127..127)
+#define MOUSE_16BIT
+
+#ifdef MOUSE_16BIT
+typedef int16_t MouseMove;
+#define MOUSE_MOVE_MAX 32767
+#else
+typedef signed char MouseMove;
+#define MOUSE_MOVE_MAX 127
+#endif
+#define MOUSE_WHEEL_MAX 127
+
 // Low level mouse report: buttons follow by X/Y change
 typedef struct __attribute__((__packed__))
 {
   uint8_t buttons;
-  signed char x;
-  signed char y;
+  MouseMove x;
+  MouseMove y;
   signed char wheel;
 } MouseReport;
 
@@ -62,7 +74,7 @@ public:
   void begin(void);
   void end(void);
   void click(uint8_t b = MOUSE_LEFT, bool dual = false);
-  void move(signed char x, signed char y, signed char wheel = 0, bool dual = false); 
+  void move(MouseMove x, MouseMove y, signed char wheel = 0, bool dual = false); 
   void press(uint8_t b = MOUSE_LEFT, bool dual = false);   // press LEFT by default
   void release(uint8_t b = MOUSE_LEFT, bool dual = false); // release LEFT by default
   bool isPressed(uint8_t b = MOUSE_LEFT, bool dual = false); // check LEFT by default